@@ -12,8 +12,24 @@
 #include "ext_obex.h"
 #include "z_dsp.h"
 #include "r_pfft.h"
+#include "ext_buffer.h"
+#include "ext_systhread.h"
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
 
 #define DEFAULT_FFT_SIZE 4096
+#define MIN_FFT_SIZE 1
+#define MAX_FFT_SIZE 4194304            // Largest number of bins tested (about 270MB of state); sizes don't need to be powers of 2
 #define DEFAULT_LENGTH 10
 #define MAX_LENGTH 30
 #define MIN_LENGTH 0
@@ -21,21 +37,281 @@
 #define MAX_VARIANCE 15
 #define MIN_VARIANCE 0
 #define MIN_INTERP_FRAMES 1
+#define MAX_SNAPSHOTS 16
+#define MAX_OVERLAP 5                   // Maximum crossfade time (in seconds) between consecutive glides
+#define MAX_REST 30                     // Maximum rest time (in seconds) between consecutive glides
+#define MAX_BANDS 1024                  // Most log-frequency bands in band mode
+#define MAX_CEPSTRUM 128                // Most cepstral coefficients in cepstrum mode
+#define MAX_VARIANTS 64                 // Most interpolation states one object can run from the same input
+#define MAX_ENVELOPE_GAIN 9.21          // Largest envelope correction in cepstrum mode, as a natural log (80 dB)
+#define REST_WHEEL_SIZE 1024            // Number of slots in the timing wheel for resting bins (must be a power of 2)
+#define EVENT_LOG_SIZE 256              // Number of records in the audio-thread event log (must be a power of 2)
+#define EVENT_LOG_INTERVAL 1000         // Milliseconds between event log summaries
+#define PROBE_LOG_SIZE 1024             // Number of frames the probe log holds between probedump messages (must be a power of 2)
+#define PROBE_CHANNELS 8                // Number of values recorded per probed frame (one buffer~ channel each)
+#define SHADOW_BINS 1024                // Most bins copied for one shadow check
+#define SHADOW_TOLERANCE 1e-9           // Largest relative difference between the live and reference outputs that isn't reported
+#define SHADOW_POLL 5                   // Milliseconds between shadow thread passes
+#define CHECKPOINT_MAGIC "NBCK"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_REGIONS 48           // Most regions of state a checkpoint can hold
+#define CHECKPOINT_POLL 20              // Milliseconds between checkpoint writer passes
+#define RETARGET_BURST_FRACTION 0.5     // Log a retarget burst when more than this fraction of a vector retargets at once
+#define DENORMAL_THRESHOLD 1e-30        // Targets and increments smaller than this are flushed to zero
+#define MIN_CARTESIAN_POWER 1e-24       // In cartesian mode, bins with less power than this are output without magnitude correction
+#define IDLE_FLOOR 1e-9                 // Input and output below this level count as silence for idle detection
+#define FRAME_CACHE_SLOTS 16            // Number of decoded file frames kept in memory
+#define FRAME_CACHE_LOOKAHEAD 8         // Number of frames the prefetcher keeps decoded ahead of the play position
+#define PREFETCH_INTERVAL 2             // Milliseconds between prefetcher passes
+#define RECORD_INTERVAL 2               // Milliseconds between record writer passes
+#define RECORD_BUFFER_BYTES 1048576     // Size of the record buffer (but it always holds at least MIN_RECORD_FRAMES frames)
+#define MIN_RECORD_FRAMES 4
+#define HALF_MAX 65504.                 // Largest finite half-precision value
+#define MAX_COMPACT_FRAMES 65535        // Longest glide (in frames) the compact layout's 16-bit counters can hold
+
+// Event types recorded by the perform method
+enum {
+    EVENT_CLAMP,            // An FFT index was outside 0 to fftSize-1 and had to be clamped (value: the offending index)
+    EVENT_RETARGET_BURST,   // Many bins retargeted in the same vector (value: number of bins)
+    EVENT_DENORMAL,         // Denormal targets or increments were flushed to zero (value: number of values flushed)
+    EVENT_PARAMS,           // The perform method picked up a new interpolation length/variance (value: interpMax in frames)
+    EVENT_CACHE_MISS,       // A file frame hadn't been decoded in time and the previous frame was reused (value: the missing frame)
+    EVENT_RECORD_DROP,      // The record buffer was full and an output frame wasn't recorded (value: the frame, counted from the start of recording)
+    EVENT_SHADOW,           // The live kernel's output differed from the reference kernel's (value: the largest relative difference)
+    EVENT_CHECKPOINT_SKIP,  // A checkpoint was due but the last one was still being written (value: the frame)
+    EVENT_RESUME_MISMATCH,  // A checkpoint no longer matched the object's state when it was due to be resumed (value: the frame)
+    EVENT_OVERRUN,          // A frame took longer to process than the frame period (value: processing time / frame period)
+    NUM_EVENT_TYPES
+};
+
+// Spectral frame file header (see README). All fields are little-endian.
+#define FRAME_FILE_MAGIC "NBSF"
+#define FRAME_FILE_VERSION 1
+typedef struct _framefile_header {
+    char        magic[4];       // "NBSF"
+    uint32_t    version;        // FRAME_FILE_VERSION
+    uint32_t    bins;           // Number of bins per frame
+    uint32_t    hop;            // Hop size in samples between frames (informational)
+    uint32_t    sampleRate;     // Sample rate of the analysis (informational)
+    uint32_t    cartesian;      // 0 if frames hold magnitude/phase, 1 if they hold real/imaginary
+    uint64_t    frames;         // Number of frames following the header
+} t_framefile_header;           // Followed by frames * (bins float32 magnitudes/reals, then bins float32 phases/imaginaries)
+
+// SDIF files (see README). All fields are big-endian.
+#define SDIF_MAGIC "SDIF"
+#define SDIF_HEADER_SIZE 16             // "SDIF", header size (8), specification version, standard types version
+#define SDIF_FRAME_HEADER_SIZE 24       // Signature, size, time, stream ID, matrix count
+#define SDIF_MATRIX_HEADER_SIZE 16      // Signature, data type, rows, columns
+#define SDIF_FLOAT32 0x0004
+#define SDIF_FLOAT64 0x0008
+
+// Frame file formats
+enum {
+    FILE_NBSF,              // t_framefile_header followed by float32 frames
+    FILE_SDIF_STF,          // SDIF 1STF (short-time Fourier) frames, one row of real/imaginary per bin
+    FILE_SDIF_TRC           // SDIF 1TRC (sinusoidal track) frames, one row of index/frequency/amplitude/phase per partial
+};
+
+// Where to find one frame's matrix in an SDIF file
+typedef struct _sdifframe {
+    uint64_t    offset;         // Offset of the matrix data from the start of the file
+    uint32_t    rows;
+    uint16_t    cols;
+    uint16_t    size;           // Bytes per value (4 or 8)
+} t_sdifframe;
+
+// Frame cache slot states
+enum {
+    SLOT_EMPTY,
+    SLOT_LOADING,           // Being filled by the prefetcher
+    SLOT_READY
+};
+
+// One decoded frame in the frame cache
+typedef struct _frameslot {
+    atomic_int      state;
+    atomic_long     frame;          // The file frame held by the slot (valid when state is SLOT_READY)
+    atomic_ulong    lastUsed;       // When the perform method last read the slot, for least-recently-used eviction
+    float*          data;           // bins magnitudes/reals followed by bins phases/imaginaries
+} t_frameslot;
+
+// A memory-mapped spectral frame file
+typedef struct _framefile {
+    void*       map;            // Start of the mapping (the header)
+    size_t      mapSize;
+    const float* data;          // First frame
+    long        bins;
+    long        frames;
+    long        hop;
+    char        cartesian;
+    char        format;         // FILE_NBSF, FILE_SDIF_STF or FILE_SDIF_TRC
+    t_sdifframe* index;         // Location of each frame's matrix (SDIF only)
+    double      binsPerHz;      // Converts 1TRC partial frequencies to bins
+    double      trcScale;       // Multiplies 1TRC amplitudes
+    
+    // Decoded frames. The prefetcher is the only thread that reads the mapping (and can block on a page fault);
+    // the perform method only ever reads slots that are already SLOT_READY.
+    t_frameslot slots[FRAME_CACHE_SLOTS];
+    float*      cache;          // Storage for the slots' data
+    atomic_int  pinned;         // Slot the perform method is reading, which the prefetcher must not evict (-1 if none)
+} t_framefile;
+
+// Output recording. The perform method copies each output frame into a ring of frames and a writer thread appends them to an SDIF file.
+typedef struct _recorder {
+    FILE*           file;
+    long            bins;
+    long            slots;          // Number of frames in the ring
+    float*          ring;           // slots frames, each one bins magnitudes/reals followed by bins phases/imaginaries
+    double*         times;          // Time of the frame in each slot, in seconds from the start of recording
+    char*           polar;          // 1 if the frame in each slot holds magnitude/phase rather than real/imaginary
+    atomic_ulong    write;          // Frames completed by the perform method
+    atomic_ulong    read;           // Frames written by the writer thread
+    char            filling;        // 1 while the perform method is filling slot write (only used by the perform method)
+    long            frames;         // Frames started since recording began, including dropped ones (only used by the perform method)
+    long            seen;           // Highest bin filled so far in the current frame, plus 1 (only used by the perform method)
+    double          hopTime;        // Seconds between frames
+    double          windowTime;     // Seconds in each FFT
+    long            fftSize;
+    t_systhread     thread;
+    atomic_int      stop;           // Tells the writer thread to write what's left in the ring and exit
+    char            failed;         // Set by the writer thread if a write fails
+} t_recorder;
+
+// A checkpoint file is a header followed by regions of state, each a t_checkpoint_region and the raw bytes.
+// Values are stored in the machine's own byte order, so checkpoints are only meant to be resumed on the machine that wrote them.
+typedef struct _checkpoint_header {
+    char        magic[4];       // CHECKPOINT_MAGIC
+    uint32_t    version;        // CHECKPOINT_VERSION
+    int64_t     fftSize;
+    int32_t     compact;
+    int32_t     regions;        // Number of regions that follow
+    int64_t     frame;          // Frame number the checkpoint was taken at
+} t_checkpoint_header;
+
+typedef struct _checkpoint_region {
+    char        tag[4];         // Name of the region, so a mismatch can be reported
+    uint32_t    reserved;
+    uint64_t    size;           // Bytes of state that follow
+} t_checkpoint_region;
+
+// One region of the object's state saved in a checkpoint
+typedef struct _region {
+    const char* tag;
+    void*       data;
+    size_t      size;
+} t_region;
+
+// Periodic checkpoints. The perform method copies the state into image on a frame boundary and the writer thread writes it out.
+typedef struct _checkpointer {
+    char            path[MAX_PATH_CHARS];
+    long            interval;       // Frames between checkpoints
+    char*           image;          // The checkpoint, laid out exactly as in the file
+    size_t          capacity;       // Size of image
+    size_t          needed;         // Size of the last checkpoint that didn't fit in image
+    atomic_size_t   size;           // Bytes of image to write, or SIZE_MAX to grow it. Non-zero while the writer thread owns image.
+    t_systhread     thread;
+    atomic_int      stop;           // Tells the writer thread to finish the checkpoint in hand and exit
+    char            failed;         // Set by the writer thread if a write fails
+} t_checkpointer;
+
+// A checkpoint read by the resume message, waiting for the perform method to pick it up
+typedef struct _resume {
+    size_t      size;
+    char        image[];
+} t_resume;
+
+typedef struct _interp_event {
+    short       type;
+    long        frame;          // Frame number the event happened in
+    double      value;
+} t_interp_event;
+
+// One frame of the probed bin's state, taken at the start of the frame
+typedef struct _probe_record {
+    long        frame;          // Frame number
+    double      currMag;
+    double      currPhase;
+    double      targetMag;
+    double      targetPhase;
+    double      incMag;
+    double      incPhase;
+    long        framesLeft;     // Frames until the bin reaches its target
+} t_probe_record;
+
+// Band mode state. The interpolation runs on the RMS level of each log-spaced band instead of on every bin.
+typedef struct _bands {
+    int         count;                  // Number of bands
+    char        measuring;              // 1 until the first levels have been measured over the current layout
+    long        bins;                   // Number of bins the bands are spread over
+    long        seen;                   // Highest bin seen so far in the current frame, plus 1
+    long        edge[MAX_BANDS+1];      // First bin of each band (edge[count] is bins)
+    double      curr[MAX_BANDS];        // Current (interpolated) level of each band
+    double      inc[MAX_BANDS];         // Amount to increment each level per frame
+    long        left[MAX_BANDS];        // Frames until each band reaches its target
+    double      live[MAX_BANDS];        // RMS level of each band in the last complete input frame
+    double      energy[MAX_BANDS];      // Energy of each band accumulated over the current frame
+    double      ratio[MAX_BANDS];       // curr / live, the gain applied to the bins of each band in the current frame
+} t_bands;
+
+// Cepstrum mode state. The interpolation runs on the first few coefficients of the real cepstrum (a DCT of the log magnitudes),
+// which describe the spectral envelope.
+typedef struct _cepstrum {
+    int         count;                      // Number of coefficients
+    char        measuring;                  // 1 until the first envelope has been measured
+    long        bins;                       // Number of bins in the last complete frame (the DCT length, 0 straight after setup)
+    long        seen;                       // Highest bin seen so far in the current frame, plus 1
+    double      curr[MAX_CEPSTRUM];         // Current (interpolated) coefficients
+    double      inc[MAX_CEPSTRUM];          // Amount to increment each coefficient per frame
+    long        left[MAX_CEPSTRUM];         // Frames until each coefficient reaches its target
+    double      live[MAX_CEPSTRUM];         // Coefficients of the last complete input frame
+    double      sum[MAX_CEPSTRUM];          // Coefficients accumulated over the current frame
+    double      diff[MAX_CEPSTRUM];         // Weighted curr - live, the log envelope correction for the current frame
+} t_cepstrum;
+
+// Optional stages of the interpolation kernel (see glide)
+enum {
+    STAGE_OVERLAP   = 1 << 0,   // Crossfade between consecutive glides
+    STAGE_CARTESIAN = 1 << 1,   // Magnitude-preserving cartesian mode
+    STAGE_REST      = 1 << 2,   // Rest phases between glides
+    STAGE_COMPACT   = 1 << 3,   // Compact state layout
+    STAGE_GAIN      = 1 << 4,   // Output gain
+    STAGE_GATE      = 1 << 5    // Spectral gate
+};
+
+// A kernel turns one vector of input bins into output bins. The perform method calls whichever kernel is current,
+// so modes can be switched by swapping the pointer instead of rebuilding the DSP chain.
+struct _interp;
+typedef void (*t_interp_kernel)(struct _interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long n);
 
 typedef struct _interp {
 	t_pxobject	ob;             // The object "base class"
-	double		fftSize;
+	long		fftSize;
     int         sampleRate;
 
-    t_atom*     currMag;        // Contains the current magnitude/real values for each FFT bin (used while interpolating to the target magnitudes)
-    t_atom*     currPhase;      // Contains the current phase/imaginary values for each FFT bin (used while interpolating to the target phases)
-    t_atom*     targetMag;      // Target list of magnitudes for the interpolation
-    t_atom*     targetPhase;    // Target list of phases for the interpolation
-    t_atom*     incMag;         // Amount to increment each magnitude per frame
-    t_atom*     incPhase;       // Amount to increment each phase per frame
-    t_atom*     totalFrames;    // Total number of frames used for the interpolation
-    t_atom*     frameCount;     // The current frame of the interpolation (frameCount/totalFrames * 100 = interpolation %)
-    t_atom*     updateTarget;   // For each FFT bin, set updateTarget to 1 if the bin has reached the target needs a new target, 0 otherwise
+    // Per-bin interpolation state. Each field is a plain array indexed by FFT bin so the perform loop
+    // can walk the state in a single pass without going through t_atom type tags.
+    // All of the arrays live in one allocation (stateBlock), each padded to a multiple of 8 bins.
+    char*       stateBlock;
+    size_t      stateSize;      // Size of stateBlock in bytes
+    double*     currMag;        // Contains the current magnitude/real values for each FFT bin (used while interpolating to the target magnitudes)
+    double*     currPhase;      // Contains the current phase/imaginary values for each FFT bin (used while interpolating to the target phases)
+    double*     targetMag;      // Target list of magnitudes for the interpolation
+    double*     targetPhase;    // Target list of phases for the interpolation
+    double*     incMag;         // Amount to increment each magnitude per frame
+    double*     incPhase;       // Amount to increment each phase per frame
+    long*       totalFrames;    // Total number of frames used for the interpolation
+    long*       frameCount;     // The current frame of the interpolation (frameCount/totalFrames * 100 = interpolation %)
+    char*       updateTarget;   // For each FFT bin, set updateTarget to 1 if the bin has reached the target needs a new target, 0 otherwise
+    
+    // Compact layout (fourth argument). The targets and snapshots are only read when a bin retargets or morphs, so they are stored as
+    // half-precision floats, and each bin's totalFrames/frameCount pair becomes a single 16-bit countdown. currMag/currPhase and the
+    // increments stay in double. Half values are scaled by halfScale (a power of 2 chosen from the FFT size) to keep them in range.
+    char        compact;        // 1 if the compact layout is in use (targetMag, targetPhase, totalFrames and frameCount are then NULL)
+    uint16_t*   targetMagHalf;  // Half-precision targets
+    uint16_t*   targetPhaseHalf;
+    uint16_t*   framesLeft;     // Frames left until each bin reaches its target
+    double      halfScale;      // Multiplier applied before converting to half precision
+    double      halfUnscale;    // 1 / halfScale
     
     float       interpLengthSecs;       // Base number of seconds to spend interpolating between the start and goal FFT snapshots
     float       interpVarianceSecs;     // Maximum allowable random variance to add or subtract to the base interpolation length (in seconds)
@@ -43,26 +319,293 @@ typedef struct _interp {
     int         interpVarianceFrames;   // (interpVarianceSecs * sampleRate) / fftSize
     int         interpMin;              // Max((interpLengthFrames - interpVarianceFrames), 1)
     int         interpMax;              // interpLengthFrames + interpVarianceFrames
+    uint64_t    rngState;               // Per-instance random number generator state (libc random() is shared between threads)
+    
+    // Overlap mode. When a bin retargets, the outgoing glide keeps running on a second lane and is crossfaded into the new glide
+    // so the slope of each bin changes gradually instead of switching at the target.
+    double*     fadeMag;                // Outgoing glide magnitude/real value for each bin (allocated on the first overlap message)
+    double*     fadePhase;              // Outgoing glide phase/imaginary value for each bin
+    double*     fadeIncMag;             // Per-frame magnitude/real increment of the outgoing glide
+    double*     fadeIncPhase;           // Per-frame phase/imaginary increment of the outgoing glide
+    long*       fadeCount;              // Number of frames left in each bin's crossfade (0 when the bin isn't fading)
+    float       overlapSecs;            // Crossfade length in seconds (0 switches overlap mode off)
+    int         overlapFrames;          // (overlapSecs * sampleRate) / fftSize
+    // Rest phases. When a glide ends, a bin can hold its value for a random time before it retargets. Resting bins are cleared in
+    // restAwake and parked in a timing wheel slot chosen by the frame they wake up in, so the kernel doesn't visit them until then.
+    float       restSecs;                       // Longest rest in seconds (0 switches rests off)
+    int         restFrames;                     // (restSecs * sampleRate) / fftSize
+    uint64_t*   restAwake;                      // One bit per bin, set unless the bin is resting (allocated on the first rest message)
+    long*       wakeFrame;                      // Frame number each resting bin wakes up in
+    int32_t*    restNext;                       // Next resting bin in the same wheel slot (-1 ends the list)
+    int32_t     restWheel[REST_WHEEL_SIZE];     // First resting bin in each wheel slot (-1 if none)
+    
+    // Cartesian mode. Interpolating real and imaginary parts linearly collapses the magnitude mid-glide, so the magnitude gets its own
+    // linear glide and the interpolated complex value is rescaled to it.
+    double*     currAbs;                // Current magnitude of each bin (allocated on the first cartesian message)
+    double*     incAbs;                 // Amount to increment each magnitude per frame
+    char        cartesian;              // 1 if the perform method is preserving magnitude
+    char        cartesianRequest;       // Set by the cartesian message, picked up by the perform method on the next frame boundary
+    // Band mode. Each band's level glides like a bin does, and every bin in the band is output with the input's fine structure
+    // rescaled to that level. The input level of a band is only known once the whole frame has gone past, so it lags by a frame.
+    t_bands*    bands;                  // Band state (allocated on the first bands message)
+    int         bandRequest;            // Set by the bands message, picked up by the perform method on the next frame boundary
+    // Cepstrum mode works the same way, except that the interpolated values are cepstral coefficients rather than band levels
+    t_cepstrum* cepstrum;               // Cepstrum state (allocated on the first cepstrum message)
+    int         cepstrumRequest;        // Set by the cepstrum message, picked up by the perform method on the next frame boundary
+    // Idle detection. Once the input has been silent long enough for every glide to settle, the perform method just writes zeros
+    // until the input comes back.
+    char        idle;                   // 1 if idle detection is enabled
+    char        sleeping;               // 1 while the perform method is idling
+    long        silentFrames;           // Number of consecutive frames with silent input
+    double      inPeak;                 // Largest input value seen so far in the current frame
+    double      outPeak;                // Largest output value seen so far in the current frame
+    
+    // Kernel selection. The bypass and freeze messages publish modeKernel; the perform method copies it (or the morph/idle kernel) into kernel on frame boundaries.
+    t_interp_kernel kernel;                 // The kernel the perform method is calling (only touched by the perform method)
+    _Atomic(t_interp_kernel) modeKernel;    // The kernel requested by the bypass and freeze messages
+    char        bypass;                 // 1 if the input is passed straight through
+    double      gain;                   // Output gain (1 leaves the gain stage out of the kernel)
+    double      gate;                   // Output bins quieter than this are zeroed (0 leaves the gate stage out of the kernel)
+    char        freeze;                 // 1 if the output is held at the current values
+    
+    double*     scratch;                // Per-vector scratch space: three vectors of scratchSize doubles (magnitude lane, file magnitudes, file phases)
+    long        scratchSize;            // The maximum vector size
+    
+    // Snapshot morphing. Snapshots are stored snapshot-major (slot * fftSize + bin) so the blend kernel reads each one contiguously.
+    double*     snapMag;                        // MAX_SNAPSHOTS stored frames of magnitude/real values (allocated on the first snap message)
+    double*     snapPhase;                      // MAX_SNAPSHOTS stored frames of phase/imaginary values
+    uint16_t*   snapMagHalf;                    // The same in half precision, used instead of snapMag/snapPhase in the compact layout
+    uint16_t*   snapPhaseHalf;
+    char        snapFilled[MAX_SNAPSHOTS];      // 1 once a snapshot slot holds a complete frame
+    int         snapRequest;                    // Slot to capture on the next frame boundary (-1 if none)
+    int         snapCapture;                    // Slot currently being captured (-1 if none)
+    char        morphing;                       // 1 when the output is the weighted sum of the snapshots rather than the per-bin glide
+    char        morphPending;                   // Set by the morph message, picked up by the perform method on the next frame boundary
+    double      morphNext[MAX_SNAPSHOTS];       // Weights requested by the last morph message (normalized to sum to 1)
+    double      morphWeights[MAX_SNAPSHOTS];    // Current weight of each snapshot
+    double      morphInc[MAX_SNAPSHOTS];        // Amount to increment each weight per frame
+    long        morphFrames;                    // Number of frames left in the current weight glide
+    
+    // Spectral frame file input. The perform method reads frames straight out of the mapping instead of the signal inlets.
+    _Atomic(t_framefile*) frameFile;            // The file currently mapped, or NULL
+    atomic_int      fileBusy;                   // 1 while the perform method is using frameFile, so the file isn't unmapped underneath it
+    char            playRequest;                // Set by the play message, picked up by the perform method on the next frame boundary
+    char            playing;                    // 1 if the input comes from frameFile
+    long            filePosition;               // The frame of frameFile being played
+    atomic_long     fileWanted;                 // The frame the prefetcher should decode from (the next frame to be played)
+    int             cacheSlot;                  // The cache slot the perform method is reading from (-1 if none)
+    long            cacheFrame;                 // The frame held by cacheSlot
+    unsigned long   cacheTick;                  // Counts cache reads, used as the least-recently-used clock
+    t_systhread     prefetchThread;             // Decodes upcoming frames into the cache (started by the first read message)
+    atomic_int      prefetchBusy;               // 1 while the prefetcher is using frameFile
+    atomic_int      prefetchQuit;               // Tells the prefetcher to exit
+    
+    // Recording
+    _Atomic(t_recorder*) recorder;              // The recording in progress, or NULL
+    atomic_int      recordBusy;                 // 1 while the perform method is using recorder
+    
+    // Checkpoints
+    _Atomic(t_checkpointer*) checkpointer;      // Periodic checkpoints in progress, or NULL
+    atomic_int      checkpointBusy;             // 1 while the perform method is using checkpointer
+    _Atomic(t_resume*) resumePending;           // Checkpoint to restore on the next frame boundary, or NULL
+    _Atomic(t_resume*) resumeDone;              // The last checkpoint restored, left for the main thread to free
+    
+    // Event log. The perform method is the only writer and the drain clock the only reader, so the two indices are all the synchronization needed.
+    t_interp_event  events[EVENT_LOG_SIZE];
+    atomic_ulong    eventWrite;                 // Total number of events written (only advanced by the perform method)
+    atomic_ulong    eventRead;                  // Total number of events read (only advanced by the drain clock)
+    atomic_ulong    eventsDropped;              // Events lost because the log was full
+    t_clock*        eventClock;                 // Drains the event log and posts a summary to the console
+    char            eventLogging;               // 1 if the drain clock is running
+    long            frameNumber;                // Number of frames processed since the object was created
+    long            denormalCount;              // Denormals flushed during the current perform call
+    atomic_long     paramVersion;               // Bumped every time the interpolation length/variance changes
+    long            paramSeen;                  // The last paramVersion the perform method saw
+    
+    // Frame timing. The perform method adds up the time it spends on each frame and compares it with the frame period.
+    char            timing;                     // 1 while frames are being timed
+    long            hopSize;                    // Samples between frames (the pfft~ hop size, or the FFT size outside pfft~)
+    long            spectrumBins;               // Bins that arrive each frame (half the FFT size in pfft~, unless it passes the full spectrum)
+    double          frameTime;                  // Seconds spent on the current frame so far (only used by the perform method)
+    atomic_ulong    timedFrames;                // Frames timed since the last log summary
+    atomic_ulong    timedNanos;                 // Total time spent on those frames
+    atomic_ulong    slowestNanos;               // Longest of those frames
+    
+    // Probe log. Like the event log, the perform method is the only writer and the probedump message the only reader.
+    atomic_long     probeBin;                   // Bin recorded at the start of every frame (-1 if no probe is armed)
+    t_probe_record* probes;                     // PROBE_LOG_SIZE records (allocated by the first probe message)
+    atomic_ulong    probeWrite;                 // Total number of records written (only advanced by the perform method)
+    atomic_ulong    probeRead;                  // Total number of records read (only advanced by probedump)
+    atomic_ulong    probesDropped;              // Frames not recorded because the log was full
+    
+    // Shadow checks. Every shadowInterval frames the perform method copies the state and output of up to SHADOW_BINS bins,
+    // and a low-priority thread runs the same bins through the generic kernel to check the output.
+    struct _shadow* shadow;                     // The copied state (allocated by the first shadow message)
+    atomic_long     shadowInterval;             // Frames between checks (0 if off)
+    t_systhread     shadowThread;
+    atomic_int      shadowQuit;                 // Tells the shadow thread to exit
+    long            shadowDue;                  // Frame of the next check (only used by the perform method)
+    long            shadowBin;                  // First bin of the next check (only used by the perform method)
+    long            shadowNext;                 // Bin to copy from in the current frame, or -1 (only used by the perform method)
+    
+    // Variants (fifth argument). Extra interpolation states fed the same input frames, each with its own outlet pair, random
+    // number generator and interpolation times. Each is a private t_interp with no variants of its own, run by the perform method
+    // straight after the object's own state so the input vector is still in cache.
+    struct _interp** variants;                  // variantCount extra states
+    long            variantCount;
+    struct _interp* owner;                      // The object a variant belongs to (the object itself if it isn't a variant)
 } t_interp;
 
+// Shadow check states
+enum {
+    SHADOW_IDLE,            // Free for the perform method to fill
+    SHADOW_READY,           // Filled, waiting for the shadow thread
+    SHADOW_DONE             // Checked, waiting for the perform method to log the result
+};
+
+// One shadow check. The state hands the whole struct back and forth between the perform method and the shadow thread.
+typedef struct _shadow {
+    atomic_int  state;
+    long        start;          // Position of the first copied bin in the vector
+    long        bins;           // Number of bins copied
+    long        skip;           // Random numbers the live kernel drew for the bins before start
+    double      worst;          // Largest relative difference found
+    t_interp    ref;            // The object as the reference kernel sees it, with its state arrays pointing into block
+    char*       block;          // Copied state, inputs and outputs, SHADOW_BINS of each
+    double*     inMag;
+    double*     inPhase;
+    double*     outMag;         // Output of the live kernel
+    double*     outPhase;
+    double*     refMag;         // Output of the reference kernel
+    double*     refPhase;
+    double*     index;          // 0 to SHADOW_BINS-1
+} t_shadow;
+
 
 // Method prototypes
 void *interp_new(t_symbol *s, long argc, t_atom *argv);
 void interp_free(t_interp *x);
 void interp_assist(t_interp *x, void *b, long m, long a, char *s);
+int setupState(t_interp *x);
+void freeState(t_interp *x);
+t_interp *newVariant(t_interp *x);
 void interp_bang(t_interp *x);
 void interp_float(t_interp *x, double f);
 void interp_int(t_interp *x, long n);
+void interp_snap(t_interp *x, long n);
+void interp_overlap(t_interp *x, double f);
+void interp_rest(t_interp *x, double f);
+void interp_cartesian(t_interp *x, long n);
+void interp_idle(t_interp *x, long n);
+void interp_morph(t_interp *x, t_symbol *s, long argc, t_atom *argv);
+void interp_log(t_interp *x, long n);
+void interp_timing(t_interp *x, long n);
+void interp_read(t_interp *x, t_symbol *s);
+void interp_doread(t_interp *x, t_symbol *s, long argc, t_atom *argv);
+void interp_play(t_interp *x, long n);
+void interp_record(t_interp *x, t_symbol *s);
+void interp_dorecord(t_interp *x, t_symbol *s, long argc, t_atom *argv);
+void interp_checkpoint(t_interp *x, t_symbol *s, long n);
+void interp_docheckpoint(t_interp *x, t_symbol *s, long argc, t_atom *argv);
+void interp_resume(t_interp *x, t_symbol *s);
+void interp_doresume(t_interp *x, t_symbol *s, long argc, t_atom *argv);
+void interp_bypass(t_interp *x, long n);
+void interp_freeze(t_interp *x, long n);
+void interp_gain(t_interp *x, double f);
+void interp_bands(t_interp *x, long n);
+void interp_cepstrum(t_interp *x, long n);
+void interp_gate(t_interp *x, double f);
+void interp_probe(t_interp *x, long n);
+void interp_shadow(t_interp *x, long n);
+void interp_variant(t_interp *x, t_symbol *s, long argc, t_atom *argv);
+void interp_probedump(t_interp *x, t_symbol *s);
+void interp_doprobedump(t_interp *x, t_symbol *s, long argc, t_atom *argv);
+void interp_drainlog(t_interp *x);
+void drainEvents(t_interp *x, t_interp *v, const char *prefix);
 void interp_dsp64(t_interp *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
+int prepareDsp(t_interp *x, double samplerate, long maxvectorsize);
 void interp_perform64(t_interp *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
 
 // Helper functions
-void updateTarget(t_interp *x, t_double mag, t_double phase, t_double fftBin);
-double getFFTSize(t_interp *x);
+void updateTarget(t_interp *x, t_double mag, t_double phase, long bin);
+long getFFTSize(t_interp *x, long requested);
 void setInterpolationTime(t_interp *x, float interpLengthSecs, float interpVarianceSecs);
-int secondsToFrames(float seconds, int sampleRate, int fftSize);
-float frand(float min, float max);
-int irand(int min, int max);
+int secondsToFrames(float seconds, int sampleRate, long fftSize);
+void seedRandom(t_interp *x, uint64_t seed);
+uint32_t nextRandom(t_interp *x);
+float frand(t_interp *x, float min, float max);
+int irand(t_interp *x, int min, int max);
+void startMorph(t_interp *x);
+void advanceMorph(t_interp *x);
+void startRest(t_interp *x, long bin);
+void wakeRested(t_interp *x);
+void wakeAllRested(t_interp *x);
+void blendSnapshots(t_interp *x, double *in_index, double *out_mag, double *out_phase, long n);
+void logEvent(t_interp *x, short type, double value);
+double monotonicTime(void);
+void finishFrameTiming(t_interp *x);
+void probeFrame(t_interp *x, long bin);
+t_shadow *newShadow(void);
+void scheduleShadow(t_interp *x, long interval);
+int canShadow(t_interp *x, double *in_index, long n);
+int captureShadow(t_interp *x, double *in_mag, double *in_phase, double *in_index, long n);
+void finishShadow(t_interp *x, double *out_mag, double *out_phase);
+void *interp_shadowcheck(t_interp *x);
+void checkShadow(t_shadow *s);
+void outputPath(const char *name, char *nativepath);
+void startCartesian(t_interp *x);
+void preserveMagnitude(double *re, double *im, const double *mag, long n);
+uint16_t packHalf(t_interp *x, double v);
+double unpackHalf(t_interp *x, uint16_t h);
+void loadTarget(t_interp *x, long bin, double *mag, double *phase);
+long remainingFrames(t_interp *x, long bin);
+double vectorPeak(const double *v, long n, double peak);
+t_framefile *openFrameFile(t_interp *x, const char *path);
+void closeFrameFile(t_framefile *file);
+void swapFrameFile(t_interp *x, t_framefile *file);
+t_framefile *newFrameFile(t_interp *x, const char *path, void *map, size_t mapSize, long bins);
+t_framefile *openSdifFile(t_interp *x, const char *path, void *map, size_t mapSize);
+long scanSdifFile(const unsigned char *map, size_t mapSize, t_sdifframe *index, char *format);
+void decodeFrame(t_framefile *file, long frame, float *out);
+t_recorder *startRecording(t_interp *x, const char *path);
+void stopRecording(t_interp *x);
+void *interp_recordwriter(t_recorder *r);
+int writeSdifFrame(t_recorder *r, long slot);
+void recordVector(t_interp *x, t_recorder *r, double *in_index, double *out_mag, double *out_phase, long n);
+int listRegions(t_interp *x, t_region *regions);
+size_t checkpointSize(t_region *regions, int count);
+t_checkpointer *startCheckpoints(t_interp *x, const char *path, long interval);
+void stopCheckpoints(t_interp *x);
+void *interp_checkpointwriter(t_checkpointer *cp);
+int writeCheckpoint(t_checkpointer *cp, size_t size);
+void takeCheckpoint(t_interp *x, t_checkpointer *cp);
+const char *matchCheckpoint(t_interp *x, const char *image, size_t size);
+void restoreCheckpoint(t_interp *x, t_resume *resume);
+void readFileFrame(const float *frame, long bins, double *in_index, double *mag, double *phase, long n);
+void *interp_prefetch(t_interp *x);
+void prefetchFrames(t_framefile *file, long wanted);
+void publishMode(t_interp *x);
+t_interp_kernel chooseKernel(t_interp *x);
+t_interp_kernel runningKernel(t_interp *x);
+void setupBands(t_interp *x, int count);
+void advanceBands(t_interp *x);
+long findBand(const t_bands *bands, long bin);
+void layoutBands(t_bands *bands, long bins);
+void setupCepstrum(t_interp *x, int count);
+void advanceCepstrum(t_interp *x);
+void cepstrumKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long n);
+void bandKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long n);
+unsigned activeStages(t_interp *x);
+t_interp_kernel selectGlide(t_interp *x);
+void glideKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long n);
+void sleepKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long n);
+void morphKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long n);
+void bypassKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long n);
+void freezeKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long n);
+void shapeVector(t_interp *x, double *out_mag, double *out_phase, long n);
+int findCachedFrame(t_framefile *file, long frame);
+int slotHolds(t_framefile *file, int slot, long frame);
+const float *cachedFrame(t_interp *x, t_framefile *file, long frame);
 
 // Global class pointer variable
 static t_class *interp_class = NULL;
@@ -81,6 +624,29 @@ void ext_main(void *r) {
     class_addmethod(c, (method)interp_bang,     "bang",                 0);
     class_addmethod(c, (method)interp_int,      "int",      A_LONG,     0);
     class_addmethod(c, (method)interp_float,    "float",    A_FLOAT,    0);
+    class_addmethod(c, (method)interp_snap,     "snap",     A_LONG,     0);
+    class_addmethod(c, (method)interp_overlap,  "overlap",  A_FLOAT,    0);
+    class_addmethod(c, (method)interp_rest,     "rest",     A_FLOAT,    0);
+    class_addmethod(c, (method)interp_cartesian,"cartesian",A_LONG,     0);
+    class_addmethod(c, (method)interp_idle,     "idle",     A_LONG,     0);
+    class_addmethod(c, (method)interp_morph,    "morph",    A_GIMME,    0);
+    class_addmethod(c, (method)interp_log,      "log",      A_LONG,     0);
+    class_addmethod(c, (method)interp_probe,    "probe",    A_LONG,     0);
+    class_addmethod(c, (method)interp_probedump,"probedump",A_SYM,      0);
+    class_addmethod(c, (method)interp_shadow,   "shadow",   A_LONG,     0);
+    class_addmethod(c, (method)interp_timing,   "timing",   A_LONG,     0);
+    class_addmethod(c, (method)interp_variant,  "variant",  A_GIMME,    0);
+    class_addmethod(c, (method)interp_read,     "read",     A_DEFSYM,   0);
+    class_addmethod(c, (method)interp_play,     "play",     A_LONG,     0);
+    class_addmethod(c, (method)interp_record,   "record",   A_DEFSYM,   0);
+    class_addmethod(c, (method)interp_checkpoint, "checkpoint", A_DEFSYM, A_DEFLONG, 0);
+    class_addmethod(c, (method)interp_resume,   "resume",   A_SYM,      0);
+    class_addmethod(c, (method)interp_bypass,   "bypass",   A_LONG,     0);
+    class_addmethod(c, (method)interp_freeze,   "freeze",   A_LONG,     0);
+    class_addmethod(c, (method)interp_gain,     "gain",     A_FLOAT,    0);
+    class_addmethod(c, (method)interp_bands,    "bands",    A_LONG,     0);
+    class_addmethod(c, (method)interp_cepstrum, "cepstrum", A_LONG,     0);
+    class_addmethod(c, (method)interp_gate,     "gate",     A_FLOAT,    0);
 	class_addmethod(c, (method)interp_dsp64,	"dsp64",	A_CANT,     0);
 	class_addmethod(c, (method)interp_assist,	"assist",	A_CANT,     0);
 
@@ -99,43 +665,199 @@ void *interp_new(t_symbol *s, long argc, t_atom *argv) {
 		dsp_setup((t_pxobject *)x, 3);	// MSP inlets: argument 2 is the # of inlets
         x->ob.z_misc = Z_NO_INPLACE;
         x->sampleRate = sys_getsr();
-        x->fftSize = getFFTSize(x);
-        srandom(time(NULL)); // Seed random numbers with the time the object is created
+        x->fftSize = getFFTSize(x, (argc > 2) ? atom_getlong(argv+2) : 0);
+        t_pfftpub *pfft = (t_pfftpub*)gensym("__pfft~__")->s_thing;
+        x->hopSize = pfft ? pfft->x_ffthop : x->fftSize;
+        x->spectrumBins = (pfft && !pfft->x_fullspect) ? x->fftSize / 2 : x->fftSize;
+        x->compact = (argc > 3) && atom_getlong(argv+3) != 0;
+        long variants = (argc > 4) ? CLAMP(atom_getlong(argv+4), 1, MAX_VARIANTS) : 1;
+        seedRandom(x, (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)x); // Seed random numbers with the time the object is created (and its address so instances created together differ)
+        x->owner = x;
 
-        // Create outlets
-        outlet_new(x, "signal");
-        outlet_new(x, "signal");
+        // Create outlets (a magnitude/phase pair per variant)
+        for (long i = 0; i < variants; i++) {
+            outlet_new(x, "signal");
+            outlet_new(x, "signal");
+        }
         
         // Set interpolation length and variance using arguments if available
         float interpLength = (argc > 0) ? atom_getfloat(argv) : DEFAULT_LENGTH;
         float interpVariance = (argc > 1) ? atom_getfloat(argv+1) : DEFAULT_VARIANCE;
         setInterpolationTime(x, interpLength, interpVariance);
         
-		// Allocate memory
-        x->currMag      = (t_atom*)sysmem_newptrclear(sizeof(t_atom) * x->fftSize);
-        x->currPhase    = (t_atom*)sysmem_newptrclear(sizeof(t_atom) * x->fftSize);
-        x->targetMag    = (t_atom*)sysmem_newptrclear(sizeof(t_atom) * x->fftSize);
-        x->targetPhase  = (t_atom*)sysmem_newptrclear(sizeof(t_atom) * x->fftSize);
-        x->incMag       = (t_atom*)sysmem_newptrclear(sizeof(t_atom) * x->fftSize);
-        x->incPhase     = (t_atom*)sysmem_newptrclear(sizeof(t_atom) * x->fftSize);
-        x->totalFrames  = (t_atom*)sysmem_newptrclear(sizeof(t_atom) * x->fftSize);
-        x->frameCount   = (t_atom*)sysmem_newptrclear(sizeof(t_atom) * x->fftSize);
-        x->updateTarget = (t_atom*)sysmem_newptrclear(sizeof(t_atom) * x->fftSize);
+        x->eventClock = clock_new(x, (method)interp_drainlog);
+        
+        if (!setupState(x)) {
+            object_error((t_object *)x, "not enough memory for an FFT size of %ld", x->fftSize);
+            object_free(x);
+            return NULL;
+        }
+        if (variants > 1) {
+            x->variants = (t_interp **)sysmem_newptrclear(sizeof(t_interp *) * (variants - 1));
+            for (long i = 0; x->variants && i < variants - 1; i++) {
+                x->variants[i] = newVariant(x);
+                if (!x->variants[i])
+                    break;
+                x->variantCount++;
+            }
+            if (x->variantCount < variants - 1) {
+                object_error((t_object *)x, "not enough memory for %ld variants", variants);
+                object_free(x);
+                return NULL;
+            }
+        }
 	}
 	return (x);
 }
 
+/**
+ * Create an extra interpolation state with the object's FFT size, layout and interpolation times, and its own random numbers
+ * @return the variant, or NULL if there isn't enough memory
+ */
+t_interp *newVariant(t_interp *x) {
+    t_interp *v = (t_interp *)sysmem_newptrclear(sizeof(t_interp));
+    if (!v)
+        return NULL;
+    v->fftSize = x->fftSize;
+    v->sampleRate = x->sampleRate;
+    v->hopSize = x->hopSize;
+    v->spectrumBins = x->spectrumBins;
+    v->compact = x->compact;
+    v->owner = x;
+    seedRandom(v, (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)v);
+    setInterpolationTime(v, x->interpLengthSecs, x->interpVarianceSecs);
+    if (!setupState(v)) {
+        freeState(v);
+        sysmem_freeptr(v);
+        return NULL;
+    }
+    return v;
+}
+
+/**
+ * Set the defaults and allocate the per-bin state of a new object (or variant)
+ * fftSize, compact and sampleRate must be set first.
+ * @return 1 on success, 0 if there isn't enough memory
+ */
+int setupState(t_interp *x) {
+    x->snapRequest = -1;
+    x->snapCapture = -1;
+    x->cacheSlot = -1;
+    x->shadowNext = -1;
+    x->gain = 1;
+    x->kernel = glideKernel;
+    atomic_init(&x->modeKernel, glideKernel);
+    atomic_init(&x->probeBin, -1);
+    
+    // Allocate memory
+    long stride = (x->fftSize + 7) & ~7L;
+    long binBytes = x->compact ? 4*sizeof(double) + 3*sizeof(uint16_t) + sizeof(char) : 6*sizeof(double) + 2*sizeof(long) + sizeof(char);
+    x->stateSize = stride * binBytes;
+    x->stateBlock = (char*)sysmem_newptrclear(x->stateSize);
+    if (!x->stateBlock)
+        return 0;
+    x->currMag      = (double*)x->stateBlock;
+    x->currPhase    = x->currMag + stride;
+    if (x->compact) {
+        x->incMag           = x->currPhase + stride;
+        x->incPhase         = x->incMag + stride;
+        x->targetMagHalf    = (uint16_t*)(x->incPhase + stride);
+        x->targetPhaseHalf  = x->targetMagHalf + stride;
+        x->framesLeft       = x->targetPhaseHalf + stride;
+        x->updateTarget     = (char*)(x->framesLeft + stride);
+        
+        // Pfft~ magnitudes grow with the FFT size, so scale by about 1/sqrt(fftSize) to keep both lanes well inside the half range
+        int exponent = 0;
+        frexp((double)x->fftSize, &exponent);
+        x->halfScale = ldexp(1., -exponent/2);
+        x->halfUnscale = 1. / x->halfScale;
+    } else {
+        x->targetMag    = x->currPhase + stride;
+        x->targetPhase  = x->targetMag + stride;
+        x->incMag       = x->targetPhase + stride;
+        x->incPhase     = x->incMag + stride;
+        x->totalFrames  = (long*)(x->incPhase + stride);
+        x->frameCount   = x->totalFrames + stride;
+        x->updateTarget = (char*)(x->frameCount + stride);
+    }
+    return 1;
+}
+
 /**
  * Destructor
  */
 void interp_free(t_interp *x) {
     dsp_free((t_pxobject*)x);
-    sysmem_freeptr(x->currMag);
-    sysmem_freeptr(x->currPhase);
-    sysmem_freeptr(x->targetMag);
-    sysmem_freeptr(x->targetPhase);
-    sysmem_freeptr(x->incMag);
-    sysmem_freeptr(x->incPhase);
+    if (x->prefetchThread) {
+        unsigned int ret;
+        atomic_store(&x->prefetchQuit, 1);
+        systhread_join(x->prefetchThread, &ret);
+    }
+    if (x->shadow) {
+        unsigned int ret;
+        atomic_store(&x->shadowQuit, 1);
+        systhread_join(x->shadowThread, &ret);
+        sysmem_freeptr(x->shadow->block);
+        sysmem_freeptr(x->shadow);
+    }
+    swapFrameFile(x, NULL);
+    stopRecording(x);
+    stopCheckpoints(x);
+    t_resume *resume = atomic_exchange(&x->resumePending, NULL);
+    if (resume)
+        sysmem_freeptr(resume);
+    resume = atomic_exchange(&x->resumeDone, NULL);
+    if (resume)
+        sysmem_freeptr(resume);
+    clock_unset(x->eventClock);
+    object_free(x->eventClock);
+    for (long i = 0; i < x->variantCount; i++) {
+        freeState(x->variants[i]);
+        sysmem_freeptr(x->variants[i]);
+    }
+    if (x->variants)
+        sysmem_freeptr(x->variants);
+    freeState(x);
+}
+
+/**
+ * Free the per-bin state and everything the optional modes allocated
+ */
+void freeState(t_interp *x) {
+    if (x->stateBlock)
+        sysmem_freeptr(x->stateBlock);
+    if (x->snapMag) {
+        sysmem_freeptr(x->snapMag);
+        sysmem_freeptr(x->snapPhase);
+    }
+    if (x->snapMagHalf) {
+        sysmem_freeptr(x->snapMagHalf);
+        sysmem_freeptr(x->snapPhaseHalf);
+    }
+    if (x->fadeMag) {
+        sysmem_freeptr(x->fadeMag);
+        sysmem_freeptr(x->fadePhase);
+        sysmem_freeptr(x->fadeIncMag);
+        sysmem_freeptr(x->fadeIncPhase);
+        sysmem_freeptr(x->fadeCount);
+    }
+    if (x->restAwake) {
+        sysmem_freeptr(x->restAwake);
+        sysmem_freeptr(x->wakeFrame);
+        sysmem_freeptr(x->restNext);
+    }
+    if (x->currAbs) {
+        sysmem_freeptr(x->currAbs);
+        sysmem_freeptr(x->incAbs);
+    }
+    if (x->scratch)
+        sysmem_freeptr(x->scratch);
+    if (x->bands)
+        sysmem_freeptr(x->bands);
+    if (x->cepstrum)
+        sysmem_freeptr(x->cepstrum);
+    if (x->probes)
+        sysmem_freeptr(x->probes);
 }
 
 /**
@@ -151,10 +873,14 @@ void interp_assist(t_interp *x, void *b, long m, long a, char *s) {
             sprintf(s, "(Signal) FFT index");
         }
 	} else if (m == ASSIST_OUTLET) {
-        if (a == 0) {
+        if (x->variantCount == 0 && a == 0) {
             sprintf(s, "(Signal) FFT magnitude or real component");
-        } else if (a == 1) {
+        } else if (x->variantCount == 0 && a == 1) {
             sprintf(s, "(Signal) FFT phase or imaginary component");
+        } else if (a % 2 == 0) {
+            sprintf(s, "(Signal) Variant %ld FFT magnitude or real component", a / 2);
+        } else {
+            sprintf(s, "(Signal) Variant %ld FFT phase or imaginary component", a / 2);
         }
 	}
 }
@@ -193,161 +919,3170 @@ void interp_int(t_interp *x, long n) {
     interp_float(x,(double)n);
 }
 
-//***********************************************************************************************
-// Helper functions
-//***********************************************************************************************
 /**
- * Random number helper function
- * @return a random float between min and max
+ * Handle snap message
+ * @param x pointer to the object struct
+ * @param n the snapshot slot (0 to MAX_SNAPSHOTS-1) to store the next input frame in
  */
-float frand(float min, float max) {
-    float scale = (float)random()/(float)RAND_MAX;
-    return min + (scale * (max-min));
+void interp_snap(t_interp *x, long n) {
+    if (n < 0 || n >= MAX_SNAPSHOTS) {
+        object_error((t_object *)x, "snap: slot must be between 0 and %d", MAX_SNAPSHOTS-1);
+        return;
+    }
+    if ((x->compact && !x->snapMagHalf) || (!x->compact && !x->snapMag)) {
+        size_t size = (x->compact ? sizeof(uint16_t) : sizeof(double)) * x->fftSize * MAX_SNAPSHOTS;
+        void *mag = sysmem_newptrclear(size);
+        void *phase = sysmem_newptrclear(size);
+        if (!mag || !phase) {
+            object_error((t_object *)x->owner, "snap: out of memory");
+            if (mag)
+                sysmem_freeptr(mag);
+            if (phase)
+                sysmem_freeptr(phase);
+            return;
+        }
+        if (x->compact) {
+            x->snapMagHalf = (uint16_t*)mag;
+            x->snapPhaseHalf = (uint16_t*)phase;
+        } else {
+            x->snapMag = (double*)mag;
+            x->snapPhase = (double*)phase;
+        }
+    }
+    x->snapRequest = n;
+    for (long i = 0; i < x->variantCount; i++)
+        interp_snap(x->variants[i], n);
 }
 
 /**
- * Random number helper function
- * @return a random int between min and max
+ * Handle overlap message
+ * @param x pointer to the object struct
+ * @param f crossfade length in seconds between a bin's outgoing and incoming glides (0 to switch overlap mode off)
  */
-int irand(int min, int max) {
-    float scale = (float)random()/(float)RAND_MAX;
-    return min + ((float)scale * (float)(max-min));
+void interp_overlap(t_interp *x, double f) {
+    x->overlapSecs = CLAMP(f, 0, MAX_OVERLAP);
+    if (x->overlapSecs > 0 && !x->fadeMag) {
+        void *fade[5];
+        fade[0] = sysmem_newptrclear(sizeof(double) * x->fftSize);
+        fade[1] = sysmem_newptrclear(sizeof(double) * x->fftSize);
+        fade[2] = sysmem_newptrclear(sizeof(double) * x->fftSize);
+        fade[3] = sysmem_newptrclear(sizeof(double) * x->fftSize);
+        fade[4] = sysmem_newptrclear(sizeof(long) * x->fftSize);
+        if (!fade[0] || !fade[1] || !fade[2] || !fade[3] || !fade[4]) {
+            object_error((t_object *)x->owner, "overlap: out of memory");
+            for (int i = 0; i < 5; i++) {
+                if (fade[i])
+                    sysmem_freeptr(fade[i]);
+            }
+            x->overlapSecs = 0;
+            x->overlapFrames = 0;
+            return;
+        }
+        x->fadePhase    = (double*)fade[1];
+        x->fadeIncMag   = (double*)fade[2];
+        x->fadeIncPhase = (double*)fade[3];
+        x->fadeCount    = (long*)fade[4];
+        x->fadeMag      = (double*)fade[0];
+    } else if (x->overlapSecs > 0 && x->overlapFrames == 0) {
+        // Re-armed after being switched off: crossfades that were cut short mustn't resume from stale fade lanes.
+        // The kernels don't touch fadeCount while overlap is off, so it's safe to clear here.
+        memset(x->fadeCount, 0, sizeof(long) * x->fftSize);
+    }
+    // Round very short crossfades up to a single frame rather than silently switching overlap mode off
+    int frames = secondsToFrames(x->overlapSecs, x->sampleRate, x->fftSize);
+    x->overlapFrames = (x->overlapSecs > 0) ? MAX(frames, 1) : 0;
+    for (long i = 0; i < x->variantCount; i++)
+        interp_overlap(x->variants[i], f);
 }
 
 /**
- * Get the fft size from a pfft~ object containing nb.binterpolate~
- * Use default FFT size if nb.binterpolate~ is not inside a pfft~ object
+ * Handle rest message
+ * @param x pointer to the object struct
+ * @param f longest time in seconds a bin holds still after reaching its target. Each rest is a random length between 0 and f.
+ * 0 (the default) starts the next glide straight away.
  */
-double getFFTSize(t_interp *x) {
-    t_pfftpub *pfft = (t_pfftpub*)gensym("__pfft~__")->s_thing;
-    if (pfft)
-        return pfft->x_fftsize;
-    else
-        return DEFAULT_FFT_SIZE;
+void interp_rest(t_interp *x, double f) {
+    x->restSecs = CLAMP(f, 0, MAX_REST);
+    if (x->restSecs > 0 && !x->restAwake) {
+        long words = (x->fftSize + 63) / 64;
+        long *wakeFrame = (long*)sysmem_newptrclear(sizeof(long) * x->fftSize);
+        int32_t *restNext = (int32_t*)sysmem_newptrclear(sizeof(int32_t) * x->fftSize);
+        uint64_t *awake = (uint64_t*)sysmem_newptr(sizeof(uint64_t) * words);
+        if (!wakeFrame || !restNext || !awake) {
+            object_error((t_object *)x->owner, "rest: out of memory");
+            if (wakeFrame)
+                sysmem_freeptr(wakeFrame);
+            if (restNext)
+                sysmem_freeptr(restNext);
+            if (awake)
+                sysmem_freeptr(awake);
+            x->restSecs = 0;
+            x->restFrames = 0;
+            return;
+        }
+        for (int i = 0; i < REST_WHEEL_SIZE; i++) {
+            x->restWheel[i] = -1;
+        }
+        memset(awake, 0xff, sizeof(uint64_t) * words);
+        x->wakeFrame = wakeFrame;
+        x->restNext = restNext;
+        x->restAwake = awake;
+    }
+    x->restFrames = secondsToFrames(x->restSecs, x->sampleRate, x->fftSize);
+    for (long i = 0; i < x->variantCount; i++)
+        interp_rest(x->variants[i], f);
 }
 
 /**
- * @return number of frames
+ * Handle cartesian message
+ * @param x pointer to the object struct
+ * @param n 1 if the input is real/imaginary and the magnitude should be preserved while interpolating, 0 to interpolate the components linearly
  */
-int secondsToFrames(float seconds, int sampleRate, int fftSize) {
-    return (int)((seconds * sampleRate) / fftSize);
+void interp_cartesian(t_interp *x, long n) {
+    if (n && !x->currAbs) {
+        double *currAbs = (double*)sysmem_newptrclear(sizeof(double) * x->fftSize);
+        double *incAbs  = (double*)sysmem_newptrclear(sizeof(double) * x->fftSize);
+        if (!currAbs || !incAbs) {
+            object_error((t_object *)x->owner, "cartesian: out of memory");
+            if (currAbs)
+                sysmem_freeptr(currAbs);
+            if (incAbs)
+                sysmem_freeptr(incAbs);
+            return;
+        }
+        x->incAbs = incAbs;
+        x->currAbs = currAbs;
+    }
+    x->cartesianRequest = (n != 0);
+    for (long i = 0; i < x->variantCount; i++)
+        interp_cartesian(x->variants[i], n);
 }
 
 /**
- * Set the minimum and maximum interpolation times that will be randomly chosen in the perform method.
+ * Handle idle message
+ * @param x pointer to the object struct
+ * @param n 1 to stop processing once the input is silent and every bin has settled, 0 (the default) to always process
  */
-void setInterpolationTime(t_interp *x, float interpLengthSecs, float interpVarianceSecs) {
-    // Set the base interpolation length in both seconds and frames
-    x->interpLengthSecs = CLAMP(interpLengthSecs, MIN_LENGTH, MAX_LENGTH);
-    x->interpLengthFrames = secondsToFrames(x->interpLengthSecs, x->sampleRate, x->fftSize);
-    x->interpLengthFrames = (x->interpLengthFrames < MIN_INTERP_FRAMES) ? MIN_INTERP_FRAMES : x->interpLengthFrames;
+void interp_idle(t_interp *x, long n) {
+    x->idle = (n != 0);
+    for (long i = 0; i < x->variantCount; i++)
+        interp_idle(x->variants[i], n);
+}
+
+/**
+ * Handle morph message
+ * @param x pointer to the object struct
+ * @param argc the number of weights
+ * @param argv one weight per snapshot slot, starting at slot 0
+ * The weights are normalized to sum to 1 and glide from their current values using the interpolation length and variance.
+ * A morph message with no weights (or only zero weights) returns to the normal per-bin interpolation.
+ */
+void interp_morph(t_interp *x, t_symbol *s, long argc, t_atom *argv) {
+    double weights[MAX_SNAPSHOTS] = {0};
+    double sum = 0;
+    for (long i = 0; i < x->variantCount; i++)
+        interp_morph(x->variants[i], s, argc, argv);
+    for (long i = 0; i < argc && i < MAX_SNAPSHOTS; i++) {
+        if (x->snapFilled[i]) {
+            weights[i] = MAX(atom_getfloat(argv+i), 0);
+            sum += weights[i];
+        }
+    }
+    if (sum <= 0) {
+        x->morphing = 0;
+        return;
+    }
+    for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+        x->morphNext[i] = weights[i] / sum;
+    }
+    x->morphPending = 1;
+}
+
+/**
+ * Handle read message
+ * @param x pointer to the object struct
+ * @param s name or path of a spectral frame file
+ * The file is opened on the main thread.
+ */
+void interp_read(t_interp *x, t_symbol *s) {
+    defer_low(x, (method)interp_doread, s, 0, NULL);
+}
+
+/**
+ * Map a spectral frame file and make it the file used by the play message
+ */
+void interp_doread(t_interp *x, t_symbol *s, long argc, t_atom *argv) {
+    char filename[MAX_PATH_CHARS];
+    char fullpath[MAX_PATH_CHARS];
+    char nativepath[MAX_PATH_CHARS];
+    short path;
+    t_fourcc type;
     
-    // Set the amount of random variance in both seconds and frames
-    x->interpVarianceSecs = CLAMP(interpVarianceSecs, MIN_VARIANCE, MAX_VARIANCE);
-    x->interpVarianceFrames = secondsToFrames(x->interpVarianceSecs, x->sampleRate, x->fftSize);
+    if (s == gensym("")) {
+        object_error((t_object *)x, "read: no file name given");
+        return;
+    }
+    strncpy_zero(filename, s->s_name, MAX_PATH_CHARS);
+    if (locatefile_extended(filename, &path, &type, NULL, 0)) {
+        object_error((t_object *)x, "read: can't find %s", s->s_name);
+        return;
+    }
+    path_toabsolutesystempath(path, filename, fullpath);
+    path_nameconform(fullpath, nativepath, PATH_STYLE_NATIVE, PATH_TYPE_ABSOLUTE);
     
-    // Set the min/max frame values
-    double minVar = x->interpLengthFrames-x->interpVarianceFrames;
-    x->interpMin = (minVar <= 0) ? 1 : minVar;
-    x->interpMax = x->interpLengthFrames+x->interpVarianceFrames;
+    t_framefile *file = openFrameFile(x, nativepath);
+    if (file) {
+        // Recordings have a bin for each one pfft~ passes, which is half the FFT size unless it passes the full spectrum
+        if (file->bins != x->spectrumBins && file->bins != x->fftSize)
+            object_warn((t_object *)x, "%s has %ld bins per frame but %ld arrive each frame (FFT size %ld)", s->s_name, file->bins, x->spectrumBins, x->fftSize);
+        swapFrameFile(x, file);
+        if (!x->prefetchThread && systhread_create((method)interp_prefetch, x, 0, 0, 0, &x->prefetchThread) != 0) {
+            x->prefetchThread = NULL;
+            object_error((t_object *)x, "read: couldn't start the prefetch thread");
+        }
+    }
 }
 
 /**
- * Update the target value for the interpolation using the given magnitude and phase values
+ * Handle play message
  * @param x pointer to the object struct
- * @param mag the new magnitude value
- * @param phase the new phase value
- * @param fftBin the fftBin index to update
+ * @param n 1 to take the input from the file loaded with the read message (looping from its first frame), 0 to go back to the signal inlets
  */
-void updateTarget(t_interp *x, t_double mag, t_double phase, t_double fftBin) {
-    // Set interpolation target to current signal value for the current fft bin
-    int bin = CLAMP(fftBin, 0, x->fftSize-1);
-    atom_setfloat(x->targetMag+bin, mag);
-    atom_setfloat(x->targetPhase+bin, phase);
+void interp_play(t_interp *x, long n) {
+    x->playRequest = (n != 0);
+}
+
+/**
+ * Handle record message
+ * @param x pointer to the object struct
+ * @param s name or path of the SDIF file to write the output to, or nothing to stop recording
+ * The file is opened and closed on the main thread.
+ */
+void interp_record(t_interp *x, t_symbol *s) {
+    defer_low(x, (method)interp_dorecord, s, 0, NULL);
+}
+
+/**
+ * Stop the current recording (if any) and start recording to a new file
+ */
+void interp_dorecord(t_interp *x, t_symbol *s, long argc, t_atom *argv) {
+    char nativepath[MAX_PATH_CHARS];
     
-    // Calculate how much to increment the current bin each frame
-    atom_setlong(x->totalFrames+bin, irand(x->interpMin, x->interpMax));
-    double magDelta = (mag-atom_getfloat(x->currMag+bin));
-    double phaseDelta = (phase-atom_getfloat(x->currPhase+bin));
-    magDelta = magDelta/atom_getlong(x->totalFrames+bin);
-    phaseDelta = phaseDelta/atom_getlong(x->totalFrames+bin);
-    atom_setfloat(x->incMag+bin, magDelta);
-    atom_setfloat(x->incPhase+bin, phaseDelta);
+    stopRecording(x);
+    if (s == gensym(""))
+        return;
+    if (x->variantCount > 0)
+        object_error((t_object *)x, "record: only variant 0 is recorded");
+    outputPath(s->s_name, nativepath);
     
-    // Reset updateTarget flag and counter
-    atom_setlong(x->updateTarget+bin, 0);
-    atom_setlong(x->frameCount+bin, 0);
+    t_recorder *r = startRecording(x, nativepath);
+    if (r)
+        atomic_store(&x->recorder, r);
 }
 
-//***********************************************************************************************
-// DSP
-//***********************************************************************************************
 /**
- * Setup DSP, called when audio is activated
- * Registers the 64-bit perform method in the signal chain in MSP
+ * Handle checkpoint message
+ * @param x pointer to the object struct
+ * @param s name or path of the file to keep the latest checkpoint in, or nothing to stop taking checkpoints
+ * @param n frames between checkpoints
  */
-void interp_dsp64(t_interp *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags) {
-    x->sampleRate = samplerate; // Update the sample rate in case it has changed since the object was created
+void interp_checkpoint(t_interp *x, t_symbol *s, long n) {
+    t_atom a;
+    atom_setlong(&a, n);
+    defer_low(x, (method)interp_docheckpoint, s, 1, &a);
+}
+
+/**
+ * Stop taking checkpoints (if they were being taken) and start taking them to a new file
+ */
+void interp_docheckpoint(t_interp *x, t_symbol *s, long argc, t_atom *argv) {
+    char nativepath[MAX_PATH_CHARS];
+    long interval = atom_getlong(argv);
     
-    // Set updateTarget to true when audio is started so that we get a new interpolation target.
-    for (int i = 0; i<x->fftSize; i++) {
-        atom_setlong(x->updateTarget+i, 1);
+    stopCheckpoints(x);
+    if (s == gensym(""))
+        return;
+    if (x->variantCount > 0) {
+        object_error((t_object *)x, "checkpoint: can't checkpoint an object with more than one variant");
+        return;
+    }
+    if (interval < 1) {
+        object_error((t_object *)x, "checkpoint: the interval must be at least 1 frame");
+        return;
     }
+    outputPath(s->s_name, nativepath);
+    t_checkpointer *cp = startCheckpoints(x, nativepath, interval);
+    if (cp)
+        atomic_store(&x->checkpointer, cp);
+}
 
-    object_method(dsp64, gensym("dsp_add64"), x, interp_perform64, 0, NULL);
+/**
+ * Handle resume message
+ * @param x pointer to the object struct
+ * @param s name or path of a checkpoint file
+ * The file is read on the main thread and the state is restored by the perform method on the next frame boundary.
+ */
+void interp_resume(t_interp *x, t_symbol *s) {
+    defer_low(x, (method)interp_doresume, s, 0, NULL);
 }
 
 /**
- * 64-bit audio perform method
+ * Read a checkpoint file and hand it to the perform method
  */
-void interp_perform64(t_interp *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam) {
-    // Input signal vectors
-	t_double *in_mag = ins[0];      // Either the real component of the FFT or the magnitude depending on if the input is in cartesian or polar coordinates
-    t_double *in_phase = ins[1];    // Either the imaginary component of the FFT or the phase depending on the coordinate system
-    t_double *in_index = ins[2];    // The FFT bin index
+void interp_doresume(t_interp *x, t_symbol *s, long argc, t_atom *argv) {
+    char nativepath[MAX_PATH_CHARS];
     
-    // Output signal vectors
-    t_double *out_mag = outs[0];	// Left outlet - magnitude/real
-    t_double *out_phase = outs[1];  // Right outlet - phase/imaginary
+    if (x->variantCount > 0) {
+        object_error((t_object *)x, "resume: can't resume an object with more than one variant");
+        return;
+    }
+    outputPath(s->s_name, nativepath);
+    FILE *fp = fopen(nativepath, "rb");
+    if (!fp) {
+        object_error((t_object *)x, "resume: can't open %s", nativepath);
+        return;
+    }
+    t_resume *resume = NULL;
+    long size = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : -1;
+    if (size > 0 && fseek(fp, 0, SEEK_SET) == 0)
+        resume = (t_resume *)sysmem_newptr(sizeof(t_resume) + size);
+    if (!resume || fread(resume->image, 1, size, fp) != (size_t)size) {
+        object_error((t_object *)x, "resume: couldn't read %s", nativepath);
+        fclose(fp);
+        if (resume)
+            sysmem_freeptr(resume);
+        return;
+    }
+    fclose(fp);
+    resume->size = size;
+    const char *mismatch = matchCheckpoint(x, resume->image, resume->size);
+    if (mismatch) {
+        object_error((t_object *)x, "resume: %s doesn't match this object (%s)", nativepath, mismatch);
+        sysmem_freeptr(resume);
+        return;
+    }
     
-    long n = sampleframes;          // Signal vector size
+    // Start decoding the file from the frame after the checkpoint, so a render resumed before DSP starts gets its first frame on time
+    t_framefile *file = atomic_load(&x->frameFile);
+    if (file) {
+        const char *p = resume->image + sizeof(t_checkpoint_header);
+        t_checkpoint_region region;
+        long position;
+        for (memcpy(&region, p, sizeof(region)); memcmp(region.tag, "fpos", 4) != 0; memcpy(&region, p, sizeof(region)))
+            p += sizeof(region) + region.size;
+        memcpy(&position, p + sizeof(region), sizeof(position));
+        atomic_store(&x->fileWanted, MAX(position + 1, 0) % file->frames);
+    }
+    
+    t_resume *old = atomic_exchange(&x->resumeDone, NULL);
+    if (old)
+        sysmem_freeptr(old);
+    old = atomic_exchange(&x->resumePending, resume);
+    if (old)
+        sysmem_freeptr(old);
+}
 
-    // Update target if interpolation is complete.
-    for (int i=0; i<sampleframes; i++) {
-        if (x->updateTarget+i != NULL && atom_getlong(x->updateTarget+i)) {
-            // Target reached - Set the old target value as the new starting point for interpolation
-            atom_setfloat(x->currMag+i, atom_getfloat(x->targetMag+i));
-            atom_setfloat(x->currPhase+i, atom_getfloat(x->targetPhase+i));
-            
-            // Update target with new inputs
-            updateTarget(x, in_mag[i], in_phase[i], in_index[i]);
+/**
+ * Handle bypass message
+ * @param x pointer to the object struct
+ * @param n 1 to pass the input straight through from the next frame, 0 to go back to interpolating
+ * The interpolation state is left alone while bypassed, so the glides carry on from where they stopped.
+ */
+void interp_bypass(t_interp *x, long n) {
+    x->bypass = (n != 0);
+    publishMode(x);
+    for (long i = 0; i < x->variantCount; i++)
+        interp_bypass(x->variants[i], n);
+}
+
+/**
+ * Handle freeze message
+ * @param x pointer to the object struct
+ * @param n 1 to hold every bin at its current value from the next frame, 0 to let the glides carry on
+ */
+void interp_freeze(t_interp *x, long n) {
+    x->freeze = (n != 0);
+    publishMode(x);
+    for (long i = 0; i < x->variantCount; i++)
+        interp_freeze(x->variants[i], n);
+}
+
+/**
+ * Handle gain message
+ * @param x pointer to the object struct
+ * @param f linear gain applied to the interpolated magnitudes (1 by default)
+ */
+void interp_gain(t_interp *x, double f) {
+    x->gain = MAX(f, 0);
+    for (long i = 0; i < x->variantCount; i++)
+        interp_gain(x->variants[i], f);
+}
+
+/**
+ * Handle bands message
+ * @param x pointer to the object struct
+ * @param n number of log-spaced bands to interpolate instead of individual bins, from the next frame (0 goes back to bins)
+ */
+void interp_bands(t_interp *x, long n) {
+    if (n > 0 && !x->bands) {
+        x->bands = (t_bands*)sysmem_newptrclear(sizeof(t_bands));
+        if (!x->bands) {
+            object_error((t_object *)x->owner, "bands: out of memory");
+            return;
         }
     }
-    
-    // Increment each bin by the appropriate amount then write its value to the corresponding output channel
-    int k = 0;
-    while (n--) {
-        // Get the FFT bin index and CLAMP it between 0 and x->fftSize to avoid a segfault if x->fftSize doesn't match the outer fft size.
-        // (Note: This won't occur if the object is used inside a pfft~ object as intended.)
-        int bin = CLAMP((int)(in_index[k]), 0, x->fftSize-1);
-        k++;
-        
-        // Get the increment amount for the current bin and add this amount to the current value for the bin
-        double incM = atom_getfloat(x->incMag+bin);
-        double incP = atom_getfloat(x->incPhase+bin);
-        atom_setfloat(x->currMag+bin, atom_getfloat(x->currMag+bin)+incM);
-        atom_setfloat(x->currPhase+bin, atom_getfloat(x->currPhase+bin)+incP);
-        
-        // Write the updated value to the output channels
-        *out_mag++ = atom_getfloat(x->currMag+bin);
-        *out_phase++ = atom_getfloat(x->currPhase+bin);
-        
-        // Increment frameCount and set the updateTarget flag to true if the current bin has reached its target
-        int framePos = atom_getlong(x->frameCount+bin)+1;
-        atom_setlong(x->frameCount+bin, framePos);
-        if (framePos >= atom_getlong(x->totalFrames+bin)) {
-            atom_setlong(x->updateTarget+bin, 1);
-            atom_setlong(x->frameCount+bin, 0);
+    x->bandRequest = (int)CLAMP(n, 0, MIN(MAX_BANDS, x->fftSize));
+    if (x->bandRequest)
+        x->cepstrumRequest = 0;
+    for (long i = 0; i < x->variantCount; i++)
+        interp_bands(x->variants[i], n);
+}
+
+/**
+ * Handle cepstrum message
+ * @param x pointer to the object struct
+ * @param n number of cepstral coefficients to interpolate instead of individual bins, from the next frame (0 goes back to bins)
+ */
+void interp_cepstrum(t_interp *x, long n) {
+    if (n > 0 && !x->cepstrum) {
+        x->cepstrum = (t_cepstrum*)sysmem_newptrclear(sizeof(t_cepstrum));
+        if (!x->cepstrum) {
+            object_error((t_object *)x->owner, "cepstrum: out of memory");
+            return;
+        }
+    }
+    x->cepstrumRequest = (int)CLAMP(n, 0, MIN(MAX_CEPSTRUM, x->fftSize));
+    if (x->cepstrumRequest)
+        x->bandRequest = 0;
+    for (long i = 0; i < x->variantCount; i++)
+        interp_cepstrum(x->variants[i], n);
+}
+
+/**
+ * Handle gate message
+ * @param x pointer to the object struct
+ * @param f bins whose interpolated magnitude is below this are output as 0 (0, the default, switches the gate off)
+ */
+void interp_gate(t_interp *x, double f) {
+    x->gate = MAX(f, 0);
+    for (long i = 0; i < x->variantCount; i++)
+        interp_gate(x->variants[i], f);
+}
+
+/**
+ * Handle log message
+ * @param x pointer to the object struct
+ * @param n 1 to periodically post a summary of the events logged by the perform method, 0 to stop
+ */
+void interp_log(t_interp *x, long n) {
+    x->eventLogging = (n != 0);
+    if (x->eventLogging) {
+        clock_fdelay(x->eventClock, EVENT_LOG_INTERVAL);
+    } else {
+        clock_unset(x->eventClock);
+    }
+}
+
+/**
+ * Handle timing message
+ * @param x pointer to the object struct
+ * @param n 1 to time every frame and report the times (and frames that overran the frame period) with the log summary, 0 to stop
+ */
+void interp_timing(t_interp *x, long n) {
+    x->timing = (n != 0);
+}
+
+/**
+ * Handle probe message
+ * @param x pointer to the object struct
+ * @param n bin whose state to record at the start of every frame, or -1 to stop recording
+ */
+void interp_probe(t_interp *x, long n) {
+    if (n >= 0 && x->variantCount > 0)
+        object_error((t_object *)x, "probe: only variant 0 is probed");
+    if (n >= 0 && !x->probes) {
+        x->probes = (t_probe_record *)sysmem_newptrclear(sizeof(t_probe_record) * PROBE_LOG_SIZE);
+        if (!x->probes) {
+            object_error((t_object *)x->owner, "probe: not enough memory for the probe log");
+            return;
+        }
+    }
+    atomic_store_explicit(&x->probeBin, (n < 0) ? -1 : MIN(n, x->fftSize-1), memory_order_release);
+}
+
+/**
+ * Handle shadow message
+ * @param x pointer to the object struct
+ * @param n check part of a vector against the generic kernel every n frames, or 0 to stop checking
+ * Differences are reported through the event log, so they are only posted while log is on.
+ */
+void interp_shadow(t_interp *x, long n) {
+    if (n > 0 && x->variantCount > 0)
+        object_error((t_object *)x, "shadow: only variant 0 is checked");
+    if (n > 0 && !x->shadow) {
+        t_shadow *s = newShadow();
+        if (!s) {
+            object_error((t_object *)x, "shadow: not enough memory");
+            return;
         }
+        x->shadow = s;
+        if (systhread_create((method)interp_shadowcheck, x, 0, SYSTHREAD_PRIORITY_MIN, 0, &x->shadowThread) != 0) {
+            object_error((t_object *)x, "shadow: couldn't start the shadow thread");
+            x->shadow = NULL;
+            sysmem_freeptr(s->block);
+            sysmem_freeptr(s);
+            return;
+        }
+    }
+    atomic_store_explicit(&x->shadowInterval, MAX(n, 0), memory_order_release);
+}
+
+/**
+ * Handle variant message
+ * @param x pointer to the object struct
+ * @param argv the variant (0 for the first outlet pair, 1 for the second and so on), its interpolation length and variance in
+ * seconds, and optionally a seed for its random numbers
+ */
+void interp_variant(t_interp *x, t_symbol *s, long argc, t_atom *argv) {
+    if (argc < 3) {
+        object_error((t_object *)x, "variant: needs a variant number, a length and a variance");
+        return;
+    }
+    long n = atom_getlong(argv);
+    if (n < 0 || n > x->variantCount) {
+        object_error((t_object *)x, "variant: must be between 0 and %ld", x->variantCount);
+        return;
+    }
+    t_interp *v = (n == 0) ? x : x->variants[n-1];
+    setInterpolationTime(v, atom_getfloat(argv+1), atom_getfloat(argv+2));
+    if (argc > 3)
+        seedRandom(v, (uint64_t)atom_getlong(argv+3));
+}
+
+/**
+ * Handle probedump message
+ * @param x pointer to the object struct
+ * @param s name of the buffer~ to copy the probe log to
+ * The buffer~ is written on the main thread.
+ */
+void interp_probedump(t_interp *x, t_symbol *s) {
+    defer_low(x, (method)interp_doprobedump, s, 0, NULL);
+}
+
+/**
+ * Move the probe log into a buffer~, one frame per sample and one value per channel (see PROBE_CHANNELS)
+ * Records that don't fit in the buffer~ are left in the log for the next probedump.
+ */
+void interp_doprobedump(t_interp *x, t_symbol *s, long argc, t_atom *argv) {
+    if (!x->probes) {
+        object_error((t_object *)x, "probedump: no probe has been set");
+        return;
+    }
+    t_buffer_ref *ref = buffer_ref_new((t_object *)x, s);
+    t_buffer_obj *buffer = buffer_ref_getobject(ref);
+    float *samples = buffer ? buffer_locksamples(buffer) : NULL;
+    if (!samples) {
+        object_error((t_object *)x, "probedump: no buffer~ named %s", s->s_name);
+        object_free(ref);
+        return;
+    }
+    long channels = buffer_getchannelcount(buffer);
+    long frames = buffer_getframecount(buffer);
+    long count = 0;
+    
+    unsigned long read = atomic_load_explicit(&x->probeRead, memory_order_relaxed);
+    unsigned long write = atomic_load_explicit(&x->probeWrite, memory_order_acquire);
+    for (; read != write && count < frames; read++, count++) {
+        const t_probe_record *p = x->probes + (read & (PROBE_LOG_SIZE-1));
+        double values[PROBE_CHANNELS] = {p->currMag, p->currPhase, p->targetMag, p->targetPhase, p->incMag, p->incPhase, p->framesLeft, p->frame};
+        for (long c = 0; c < MIN(channels, PROBE_CHANNELS); c++)
+            samples[count*channels + c] = values[c];
+    }
+    atomic_store_explicit(&x->probeRead, read, memory_order_release);
+    buffer_setdirty(buffer);
+    buffer_unlocksamples(buffer);
+    object_free(ref);
+    
+    object_post((t_object *)x, "probedump: %ld frames written to %s", count, s->s_name);
+    unsigned long dropped = atomic_exchange_explicit(&x->probesDropped, 0, memory_order_relaxed);
+    if (dropped)
+        object_warn((t_object *)x, "probedump: %lu frames dropped because the probe log was full", dropped);
+}
+
+/**
+ * Drain the event log and post one line per event type that occurred since the last summary
+ * Called by the event clock, never by the audio thread.
+ */
+void interp_drainlog(t_interp *x) {
+    drainEvents(x, x, "");
+    for (long i = 0; i < x->variantCount; i++) {
+        char prefix[32];
+        snprintf(prefix, sizeof(prefix), "variant %ld: ", i + 1);
+        drainEvents(x, x->variants[i], prefix);
+    }
+    
+    unsigned long timed = atomic_exchange_explicit(&x->timedFrames, 0, memory_order_relaxed);
+    unsigned long nanos = atomic_exchange_explicit(&x->timedNanos, 0, memory_order_relaxed);
+    unsigned long slowest = atomic_exchange_explicit(&x->slowestNanos, 0, memory_order_relaxed);
+    if (timed) {
+        double period = 1e6 * x->hopSize / x->sampleRate;
+        double mean = 1e-3 * nanos / timed;
+        object_post((t_object *)x, "frame time %.1f us mean (%.0f%% of the %.1f us frame period), %.1f us slowest (%.0f%%)",
+                    mean, 100 * mean / period, period, 1e-3 * slowest, 1e-1 * slowest / period);
+    }
+    
+    if (x->eventLogging)
+        clock_fdelay(x->eventClock, EVENT_LOG_INTERVAL);
+}
+
+/**
+ * Drain the event log of the object or one of its variants and post a line for each event type in it
+ * @param x the object to post from
+ * @param v the object itself or one of its variants
+ * @param prefix put at the start of every line, to tell the variants apart
+ */
+void drainEvents(t_interp *x, t_interp *v, const char *prefix) {
+    static const char *names[NUM_EVENT_TYPES] = {"clamped FFT indices", "retarget bursts", "denormal flushes", "parameter updates", "frame cache misses", "frames dropped from the recording", "shadow check failures",
+                                                 "checkpoints skipped", "resumes refused", "frames over the real-time budget"};
+    long counts[NUM_EVENT_TYPES] = {0};
+    double maxValue[NUM_EVENT_TYPES] = {0};
+    long lastFrame[NUM_EVENT_TYPES] = {0};
+    
+    unsigned long read = atomic_load_explicit(&v->eventRead, memory_order_relaxed);
+    unsigned long write = atomic_load_explicit(&v->eventWrite, memory_order_acquire);
+    for (; read != write; read++) {
+        t_interp_event *e = v->events + (read & (EVENT_LOG_SIZE-1));
+        if (counts[e->type] == 0 || fabs(e->value) > fabs(maxValue[e->type]))
+            maxValue[e->type] = e->value;
+        counts[e->type]++;
+        lastFrame[e->type] = e->frame;
+    }
+    atomic_store_explicit(&v->eventRead, read, memory_order_release);
+    
+    for (int i = 0; i < NUM_EVENT_TYPES; i++) {
+        if (counts[i])
+            object_post((t_object *)x, "%s%ld %s (largest %g, last at frame %ld)", prefix, counts[i], names[i], maxValue[i], lastFrame[i]);
+    }
+    unsigned long dropped = atomic_exchange_explicit(&v->eventsDropped, 0, memory_order_relaxed);
+    if (dropped)
+        object_warn((t_object *)x, "%s%lu events dropped because the log was full", prefix, dropped);
+}
+
+//***********************************************************************************************
+// Half precision
+//***********************************************************************************************
+/**
+ * Convert a float to an IEEE half-precision value (round to nearest even). Uses the F16C or ARM conversion instructions where the
+ * compiler targets them, and falls back to bit manipulation elsewhere.
+ */
+static inline uint16_t floatToHalf(float f) {
+#if defined(__F16C__)
+    return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#elif defined(__ARM_FP16_FORMAT_IEEE)
+    __fp16 h = (__fp16)f;
+    uint16_t bits;
+    memcpy(&bits, &h, sizeof(bits));
+    return bits;
+#else
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    uint16_t sign = (u >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((u >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = u & 0x7fffff;
+    uint32_t half, rest, halfway;
+    if (((u >> 23) & 0xff) == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);  // Infinity or NaN
+    if (exponent >= 31)
+        return sign | 0x7c00;                           // Overflow
+    if (exponent <= 0) {
+        // Subnormal half
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        half = mantissa >> shift;
+        rest = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    } else {
+        half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+        rest = mantissa & 0x1fff;
+        halfway = 0x1000;
+    }
+    if (rest > halfway || (rest == halfway && (half & 1)))
+        half++;                                         // A carry out of the mantissa correctly bumps the exponent
+    return sign | half;
+#endif
+}
+
+/**
+ * Convert an IEEE half-precision value to a float
+ */
+static inline float halfToFloat(uint16_t h) {
+#if defined(__F16C__)
+    return _cvtsh_ss(h);
+#elif defined(__ARM_FP16_FORMAT_IEEE)
+    __fp16 f;
+    memcpy(&f, &h, sizeof(f));
+    return f;
+#else
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t u;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            u = sign;
+        } else {
+            // Subnormal half, normalize it
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            u = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    } else if (exponent == 31) {
+        u = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        u = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+#endif
+}
+
+/**
+ * Scale a value for the compact layout and store it in half precision, saturating instead of overflowing to infinity
+ */
+uint16_t packHalf(t_interp *x, double v) {
+    return floatToHalf((float)CLAMP(v * x->halfScale, -HALF_MAX, HALF_MAX));
+}
+
+/**
+ * Undo packHalf
+ */
+double unpackHalf(t_interp *x, uint16_t h) {
+    return halfToFloat(h) * x->halfUnscale;
+}
+
+//***********************************************************************************************
+// Helper functions
+//***********************************************************************************************
+/**
+ * Seed the object's random number generator
+ * The seed is scrambled with splitmix64 so nearby seeds still give unrelated sequences.
+ */
+void seedRandom(t_interp *x, uint64_t seed) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+    x->rngState = z ? z : 1; // xorshift must never be seeded with 0
+}
+
+/**
+ * Random number helper function (xorshift64*)
+ * Each object owns its generator state, so instances running on different threads (e.g. parallel poly~ voices) never share it.
+ * @return a random 32-bit unsigned int
+ */
+uint32_t nextRandom(t_interp *x) {
+    uint64_t s = x->rngState;
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    x->rngState = s;
+    return (uint32_t)((s * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+/**
+ * Random number helper function
+ * @return a random float between min and max
+ */
+float frand(t_interp *x, float min, float max) {
+    float scale = (float)nextRandom(x)/(float)UINT32_MAX;
+    return min + (scale * (max-min));
+}
+
+/**
+ * Random number helper function
+ * @return a random int between min and max
+ */
+int irand(t_interp *x, int min, int max) {
+    float scale = (float)nextRandom(x)/(float)UINT32_MAX;
+    return min + ((float)scale * (float)(max-min));
+}
+
+/**
+ * Record an event in the event log. Only called from the perform method.
+ * If the drain clock hasn't caught up the event is counted as dropped rather than overwriting unread records.
+ */
+void logEvent(t_interp *x, short type, double value) {
+    unsigned long write = atomic_load_explicit(&x->eventWrite, memory_order_relaxed);
+    unsigned long read = atomic_load_explicit(&x->eventRead, memory_order_acquire);
+    if (write - read >= EVENT_LOG_SIZE) {
+        atomic_fetch_add_explicit(&x->eventsDropped, 1, memory_order_relaxed);
+        return;
+    }
+    t_interp_event *e = x->events + (write & (EVENT_LOG_SIZE-1));
+    e->type = type;
+    e->frame = x->frameNumber;
+    e->value = value;
+    atomic_store_explicit(&x->eventWrite, write+1, memory_order_release);
+}
+
+/**
+ * @return a monotonic time in seconds
+ */
+double monotonicTime(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/**
+ * Add the time spent on the frame that just ended to the timing totals, and log it if it took longer than the frame period.
+ * Only called from the perform method, on a frame boundary.
+ */
+void finishFrameTiming(t_interp *x) {
+    unsigned long nanos = (unsigned long)(x->frameTime * 1e9);
+    atomic_fetch_add_explicit(&x->timedFrames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&x->timedNanos, nanos, memory_order_relaxed);
+    unsigned long slowest = atomic_load_explicit(&x->slowestNanos, memory_order_relaxed);
+    while (nanos > slowest && !atomic_compare_exchange_weak_explicit(&x->slowestNanos, &slowest, nanos, memory_order_relaxed, memory_order_relaxed))
+        ;
+    double period = (double)x->hopSize / x->sampleRate;
+    if (x->frameTime > period)
+        logEvent(x, EVENT_OVERRUN, x->frameTime / period);
+    x->frameTime = 0;
+}
+
+/**
+ * Record the state of the probed bin in the probe log. Only called from the perform method, once per frame.
+ * As with the event log, frames are dropped rather than overwriting records probedump hasn't read.
+ */
+void probeFrame(t_interp *x, long bin) {
+    unsigned long write = atomic_load_explicit(&x->probeWrite, memory_order_relaxed);
+    unsigned long read = atomic_load_explicit(&x->probeRead, memory_order_acquire);
+    if (write - read >= PROBE_LOG_SIZE) {
+        atomic_fetch_add_explicit(&x->probesDropped, 1, memory_order_relaxed);
+        return;
+    }
+    t_probe_record *p = x->probes + (write & (PROBE_LOG_SIZE-1));
+    p->frame = x->frameNumber;
+    p->currMag = x->currMag[bin];
+    p->currPhase = x->currPhase[bin];
+    loadTarget(x, bin, &p->targetMag, &p->targetPhase);
+    p->incMag = x->incMag[bin];
+    p->incPhase = x->incPhase[bin];
+    p->framesLeft = x->compact ? x->framesLeft[bin] : x->totalFrames[bin] - x->frameCount[bin];
+    atomic_store_explicit(&x->probeWrite, write+1, memory_order_release);
+}
+
+/**
+ * Allocate a shadow check and point the reference object's state arrays at its copies
+ * @return the shadow check, or NULL if there isn't enough memory
+ */
+t_shadow *newShadow(void) {
+    t_shadow *s = (t_shadow *)sysmem_newptrclear(sizeof(t_shadow));
+    if (!s)
+        return NULL;
+    long n = SHADOW_BINS;
+    s->block = (char *)sysmem_newptrclear(n * (20*sizeof(double) + 3*sizeof(long) + 3*sizeof(uint16_t) + sizeof(char)));
+    if (!s->block) {
+        sysmem_freeptr(s);
+        return NULL;
+    }
+    t_interp *ref = &s->ref;
+    double *d = (double *)s->block;
+    s->inMag            = d;
+    s->inPhase          = d + n;
+    s->outMag           = d + 2*n;
+    s->outPhase         = d + 3*n;
+    s->refMag           = d + 4*n;
+    s->refPhase         = d + 5*n;
+    s->index            = d + 6*n;
+    ref->scratch        = d + 7*n;
+    ref->currMag        = d + 8*n;
+    ref->currPhase      = d + 9*n;
+    ref->targetMag      = d + 10*n;
+    ref->targetPhase    = d + 11*n;
+    ref->incMag         = d + 12*n;
+    ref->incPhase       = d + 13*n;
+    ref->fadeMag        = d + 14*n;
+    ref->fadePhase      = d + 15*n;
+    ref->fadeIncMag     = d + 16*n;
+    ref->fadeIncPhase   = d + 17*n;
+    ref->currAbs        = d + 18*n;
+    ref->incAbs         = d + 19*n;
+    ref->totalFrames    = (long *)(d + 20*n);
+    ref->frameCount     = ref->totalFrames + n;
+    ref->fadeCount      = ref->totalFrames + 2*n;
+    ref->targetMagHalf  = (uint16_t *)(ref->totalFrames + 3*n);
+    ref->targetPhaseHalf= ref->targetMagHalf + n;
+    ref->framesLeft     = ref->targetMagHalf + 2*n;
+    ref->updateTarget   = (char *)(ref->targetMagHalf + 3*n);
+    ref->scratchSize    = n;
+    for (long k = 0; k < n; k++)
+        s->index[k] = k;
+    atomic_init(&s->state, SHADOW_IDLE);
+    return s;
+}
+
+/**
+ * Pick up the result of the last shadow check and decide whether to start a new one in this frame. Only called from the perform method, on frame boundaries.
+ */
+void scheduleShadow(t_interp *x, long interval) {
+    t_shadow *s = x->shadow;
+    int state = atomic_load_explicit(&s->state, memory_order_acquire);
+    if (state == SHADOW_DONE) {
+        if (!(s->worst <= SHADOW_TOLERANCE))
+            logEvent(x, EVENT_SHADOW, s->worst);
+        atomic_store_explicit(&s->state, SHADOW_IDLE, memory_order_release);
+        state = SHADOW_IDLE;
+    }
+    if (state == SHADOW_IDLE && x->frameNumber >= x->shadowDue) {
+        x->shadowNext = x->shadowBin;
+        x->shadowDue = x->frameNumber + interval;
+    }
+}
+
+/**
+ * @return 1 if the vector can be checked: it is a run of consecutive bins going through one of the per-bin kernels, without rests
+ * (the timing wheel is shared between bins, so resting bins can't be copied on their own)
+ */
+int canShadow(t_interp *x, double *in_index, long n) {
+    long first = (long)in_index[0];
+    return first >= 0 && first + n <= x->fftSize && (long)in_index[n-1] == first + n - 1
+        && !(activeStages(x) & STAGE_REST) && x->kernel == selectGlide(x);
+}
+
+/**
+ * Copy the state and input of up to SHADOW_BINS bins from shadowNext onwards, before the kernel runs. Only called from the perform method.
+ * The bins are copied to the start of the shadow arrays, along with everything the kernel reads from the object
+ * and the random number state. The bins before shadowNext draw a random number each time they retarget,
+ * so the shadow thread skips that many to stay in step.
+ * @return 1 if the bins were copied, 0 if the vector can't be checked (the next check then starts after it)
+ */
+int captureShadow(t_interp *x, double *in_mag, double *in_phase, double *in_index, long n) {
+    t_shadow *s = x->shadow;
+    t_interp *ref = &s->ref;
+    long first = (long)in_index[0];
+    if (!canShadow(x, in_index, n)) {
+        x->shadowBin = (first + n < x->fftSize) ? first + n : 0;
+        x->shadowNext = -1;
+        return 0;
+    }
+    s->start = x->shadowNext - first;
+    s->bins = MIN(n - s->start, SHADOW_BINS);
+    s->skip = 0;
+    for (long k = 0; k < s->start; k++)
+        s->skip += x->updateTarget[first+k];
+    
+    ref->fftSize = s->bins;
+    ref->compact = x->compact;
+    ref->halfScale = x->halfScale;
+    ref->halfUnscale = x->halfUnscale;
+    ref->interpMin = x->interpMin;
+    ref->interpMax = x->interpMax;
+    ref->overlapFrames = x->overlapFrames;
+    ref->cartesian = x->cartesian;
+    ref->gain = x->gain;
+    ref->gate = x->gate;
+    ref->rngState = x->rngState;
+    ref->frameNumber = x->frameNumber;
+    for (long k = 0; k < s->bins; k++) {
+        long bin = x->shadowNext + k;
+        s->inMag[k] = in_mag[s->start + k];
+        s->inPhase[k] = in_phase[s->start + k];
+        ref->currMag[k] = x->currMag[bin];
+        ref->currPhase[k] = x->currPhase[bin];
+        ref->incMag[k] = x->incMag[bin];
+        ref->incPhase[k] = x->incPhase[bin];
+        ref->updateTarget[k] = x->updateTarget[bin];
+        if (x->compact) {
+            ref->targetMagHalf[k] = x->targetMagHalf[bin];
+            ref->targetPhaseHalf[k] = x->targetPhaseHalf[bin];
+            ref->framesLeft[k] = x->framesLeft[bin];
+        } else {
+            ref->targetMag[k] = x->targetMag[bin];
+            ref->targetPhase[k] = x->targetPhase[bin];
+            ref->totalFrames[k] = x->totalFrames[bin];
+            ref->frameCount[k] = x->frameCount[bin];
+        }
+        if (x->overlapFrames) {
+            ref->fadeMag[k] = x->fadeMag[bin];
+            ref->fadePhase[k] = x->fadePhase[bin];
+            ref->fadeIncMag[k] = x->fadeIncMag[bin];
+            ref->fadeIncPhase[k] = x->fadeIncPhase[bin];
+            ref->fadeCount[k] = x->fadeCount[bin];
+        }
+        if (x->cartesian) {
+            ref->currAbs[k] = x->currAbs[bin];
+            ref->incAbs[k] = x->incAbs[bin];
+        }
+    }
+    return 1;
+}
+
+/**
+ * Copy the live kernel's output for the bins captured by captureShadow and hand them to the shadow thread. Only called from the perform method.
+ */
+void finishShadow(t_interp *x, double *out_mag, double *out_phase) {
+    t_shadow *s = x->shadow;
+    memcpy(s->outMag, out_mag + s->start, sizeof(double) * s->bins);
+    memcpy(s->outPhase, out_phase + s->start, sizeof(double) * s->bins);
+    atomic_store_explicit(&s->state, SHADOW_READY, memory_order_release);
+    x->shadowBin = x->shadowNext + s->bins;
+    if (x->shadowBin >= x->fftSize)
+        x->shadowBin = 0;
+    x->shadowNext = -1;
+}
+
+/**
+ * Shadow thread
+ * Checks each vector copied by the perform method until the object is freed.
+ */
+void *interp_shadowcheck(t_interp *x) {
+    t_shadow *s = x->shadow;
+    while (!atomic_load(&x->shadowQuit)) {
+        if (atomic_load_explicit(&s->state, memory_order_acquire) == SHADOW_READY) {
+            checkShadow(s);
+            atomic_store_explicit(&s->state, SHADOW_DONE, memory_order_release);
+        }
+        systhread_sleep(SHADOW_POLL);
+    }
+    systhread_exit(0);
+    return NULL;
+}
+
+/**
+ * Run the copied bins through the generic kernel and store the largest relative difference from the live output in worst (NaN if either output was NaN)
+ */
+void checkShadow(t_shadow *s) {
+    t_interp *ref = &s->ref;
+    for (long i = 0; i < s->skip; i++)
+        nextRandom(ref);
+    glideKernel(ref, s->inMag, s->inPhase, s->index, s->refMag, s->refPhase, s->bins);
+    
+    double worst = 0;
+    for (long k = 0; k < s->bins; k++) {
+        double a[2] = {s->refMag[k], s->refPhase[k]};
+        double b[2] = {s->outMag[k], s->outPhase[k]};
+        for (int i = 0; i < 2; i++) {
+            double difference = (a[i] == b[i]) ? 0 : fabs(a[i] - b[i]) / MAX(fabs(a[i]), fabs(b[i]));
+            if (!(worst >= difference))
+                worst = difference;
+        }
+    }
+    s->worst = worst;
+}
+
+/**
+ * Turn the name given to a message that writes a file into a native path
+ * Relative names are put in Max's default folder.
+ */
+void outputPath(const char *name, char *nativepath) {
+    char filename[MAX_PATH_CHARS];
+    char fullpath[MAX_PATH_CHARS];
+    
+    strncpy_zero(filename, name, MAX_PATH_CHARS);
+    if (filename[0] == '/' || strchr(filename, ':'))
+        strncpy_zero(fullpath, filename, MAX_PATH_CHARS);
+    else
+        path_toabsolutesystempath(path_getdefault(), filename, fullpath);
+    path_nameconform(fullpath, nativepath, PATH_STYLE_NATIVE, PATH_TYPE_ABSOLUTE);
+}
+
+/**
+ * Switch magnitude preservation on for every bin part way through their glides
+ * The magnitude glide starts at the magnitude of the current value and ends at the magnitude of the target.
+ */
+void startCartesian(t_interp *x) {
+    for (long i = 0; i < x->fftSize; i++) {
+        double mag, phase;
+        loadTarget(x, i, &mag, &phase);
+        x->currAbs[i] = hypot(x->currMag[i], x->currPhase[i]);
+        x->incAbs[i] = (hypot(mag, phase) - x->currAbs[i]) / remainingFrames(x, i);
+    }
+    x->cartesian = 1;
+}
+
+/**
+ * @return the larger of peak and the largest absolute value in v
+ */
+double vectorPeak(const double *v, long n, double peak) {
+    for (long k = 0; k < n; k++) {
+        double a = fabs(v[k]);
+        peak = (a > peak) ? a : peak;
+    }
+    return peak;
+}
+
+/**
+ * Map a spectral frame file and check its header
+ * @return the mapped file, or NULL if it couldn't be mapped or isn't a valid frame file
+ */
+t_framefile *openFrameFile(t_interp *x, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        object_error((t_object *)x, "read: can't open %s", path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < SDIF_HEADER_SIZE) {
+        object_error((t_object *)x, "read: %s is not a spectral frame file", path);
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file open
+    if (map == MAP_FAILED) {
+        object_error((t_object *)x, "read: can't map %s", path);
+        return NULL;
+    }
+    
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    if (memcmp(map, SDIF_MAGIC, 4) == 0)
+        return openSdifFile(x, path, map, st.st_size);
+    
+    const t_framefile_header *header = (const t_framefile_header *)map;
+    uint64_t frameBytes = (uint64_t)header->bins * 2 * sizeof(float);
+    if (st.st_size < (off_t)sizeof(t_framefile_header) || memcmp(header->magic, FRAME_FILE_MAGIC, 4) != 0
+        || header->version != FRAME_FILE_VERSION || header->bins == 0
+        || header->frames == 0 || header->frames > (st.st_size - sizeof(t_framefile_header)) / frameBytes) {
+        object_error((t_object *)x, "read: %s is not a spectral frame file (or is truncated)", path);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    
+    t_framefile *file = newFrameFile(x, path, map, st.st_size, header->bins);
+    if (!file)
+        return NULL;
+    file->format = FILE_NBSF;
+    file->data = (const float *)((const char *)map + sizeof(t_framefile_header));
+    file->frames = header->frames;
+    file->hop = header->hop;
+    file->cartesian = header->cartesian != 0;
+    return file;
+}
+
+/**
+ * Set up the frame cache for a mapped file
+ * @return the new file, or NULL (having unmapped the file) if there isn't enough memory for the cache
+ */
+t_framefile *newFrameFile(t_interp *x, const char *path, void *map, size_t mapSize, long bins) {
+    t_framefile *file = (t_framefile *)sysmem_newptrclear(sizeof(t_framefile));
+    if (file)
+        file->cache = (float *)sysmem_newptrclear(sizeof(float) * bins * 2 * FRAME_CACHE_SLOTS);
+    if (!file || !file->cache) {
+        object_error((t_object *)x, "read: not enough memory to cache frames of %s", path);
+        munmap(map, mapSize);
+        if (file)
+            sysmem_freeptr(file);
+        return NULL;
+    }
+    for (int i = 0; i < FRAME_CACHE_SLOTS; i++) {
+        file->slots[i].data = file->cache + i * bins * 2;
+        atomic_init(&file->slots[i].state, SLOT_EMPTY);
+        atomic_init(&file->slots[i].frame, -1);
+    }
+    atomic_init(&file->pinned, -1);
+    file->map = map;
+    file->mapSize = mapSize;
+    file->bins = bins;
+    return file;
+}
+
+/**
+ * @return the big-endian 32-bit value at p
+ */
+static inline uint32_t readBig32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/**
+ * @return the big-endian float32 or float64 (size 4 or 8) at p
+ */
+static inline double readSdifValue(const unsigned char *p, int size) {
+    if (size == 4) {
+        union { uint32_t i; float f; } u = { readBig32(p) };
+        return u.f;
+    }
+    union { uint64_t i; double d; } u = { (uint64_t)readBig32(p) << 32 | readBig32(p + 4) };
+    return u.d;
+}
+
+/**
+ * Store v at p as a big-endian 32-bit value
+ */
+static inline void writeBig32(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/**
+ * Store v at p as a big-endian float64
+ */
+static inline void writeBigDouble(unsigned char *p, double v) {
+    union { double d; uint64_t i; } u = { v };
+    writeBig32(p, u.i >> 32);
+    writeBig32(p + 4, (uint32_t)u.i);
+}
+
+/**
+ * Walk the frame headers of a mapped SDIF file and find the 1STF or 1TRC matrices of the first stream holding either
+ * Only the headers are read, so the frame data is never paged in. Unknown frames and matrices (including the 1STF frames'
+ * ISTF matrices) are skipped, and a truncated last frame ends the scan.
+ * @param index where to store the location of each frame's matrix, or NULL to just count them
+ * @param format set to FILE_SDIF_STF or FILE_SDIF_TRC depending on the stream found
+ * @return the number of frames found
+ */
+long scanSdifFile(const unsigned char *map, size_t mapSize, t_sdifframe *index, char *format) {
+    size_t pos = 8 + readBig32(map + 4);
+    long frames = 0;
+    int64_t stream = -1;
+    
+    while (pos + SDIF_FRAME_HEADER_SIZE <= mapSize) {
+        const unsigned char *frame = map + pos;
+        size_t end = pos + 8 + readBig32(frame + 4);
+        if (end > mapSize || end < pos + SDIF_FRAME_HEADER_SIZE)
+            break;
+        
+        char kind = memcmp(frame, "1STF", 4) == 0 ? FILE_SDIF_STF : memcmp(frame, "1TRC", 4) == 0 ? FILE_SDIF_TRC : FILE_NBSF;
+        uint32_t id = readBig32(frame + 16);
+        if (kind != FILE_NBSF && stream < 0) {
+            stream = id;
+            *format = kind;
+        }
+        if (kind == *format && id == stream) {
+            uint32_t count = readBig32(frame + 20);
+            size_t m = pos + SDIF_FRAME_HEADER_SIZE;
+            for (uint32_t i = 0; i < count && m + SDIF_MATRIX_HEADER_SIZE <= end; i++) {
+                const unsigned char *matrix = map + m;
+                uint32_t type = readBig32(matrix + 4);
+                uint64_t rows = readBig32(matrix + 8);
+                uint64_t cols = readBig32(matrix + 12);
+                uint64_t bytes = (rows * cols * (type & 0xff) + 7) & ~7ULL;
+                if (m + SDIF_MATRIX_HEADER_SIZE + bytes > end)
+                    break;
+                if (memcmp(matrix, frame, 4) == 0 && (type == SDIF_FLOAT32 || type == SDIF_FLOAT64)
+                    && cols >= (kind == FILE_SDIF_STF ? 2 : 4) && cols <= UINT16_MAX) {
+                    if (index) {
+                        index[frames].offset = m + SDIF_MATRIX_HEADER_SIZE;
+                        index[frames].rows = (uint32_t)rows;
+                        index[frames].cols = (uint16_t)cols;
+                        index[frames].size = type & 0xff;
+                    }
+                    frames++;
+                    break;
+                }
+                m += SDIF_MATRIX_HEADER_SIZE + bytes;
+            }
+        }
+        pos = end;
+    }
+    return frames;
+}
+
+/**
+ * Index the frames of a mapped SDIF file
+ * 1STF files have as many bins as the first frame has rows. 1TRC partials are put in the nearest bin of the object's FFT size.
+ * Either way the frames are converted to real/imaginary if cartesian is on when the file is read, or magnitude/phase if not.
+ * @return the indexed file, or NULL (having unmapped the file) if it has no usable frames
+ */
+t_framefile *openSdifFile(t_interp *x, const char *path, void *map, size_t mapSize) {
+    char format = FILE_NBSF;
+    long frames = scanSdifFile(map, mapSize, NULL, &format);
+    if (frames == 0) {
+        object_error((t_object *)x, "read: %s has no 1STF or 1TRC frames", path);
+        munmap(map, mapSize);
+        return NULL;
+    }
+    t_sdifframe *index = (t_sdifframe *)sysmem_newptr(sizeof(t_sdifframe) * frames);
+    if (!index) {
+        object_error((t_object *)x, "read: not enough memory to index %s", path);
+        munmap(map, mapSize);
+        return NULL;
+    }
+    scanSdifFile(map, mapSize, index, &format);
+    
+    long bins = (format == FILE_SDIF_STF) ? index[0].rows : x->fftSize;
+    if (bins == 0) {
+        object_error((t_object *)x, "read: the first frame of %s is empty", path);
+        sysmem_freeptr(index);
+        munmap(map, mapSize);
+        return NULL;
+    }
+    t_framefile *file = newFrameFile(x, path, map, mapSize, bins);
+    if (!file) {
+        sysmem_freeptr(index);
+        return NULL;
+    }
+    file->format = format;
+    file->index = index;
+    file->frames = frames;
+    file->cartesian = x->cartesianRequest;
+    file->binsPerHz = (double)x->fftSize / x->sampleRate;
+    file->trcScale = x->fftSize / 2.0;
+    return file;
+}
+
+/**
+ * Unmap a spectral frame file
+ */
+void closeFrameFile(t_framefile *file) {
+    munmap(file->map, file->mapSize);
+    if (file->index)
+        sysmem_freeptr(file->index);
+    sysmem_freeptr(file->cache);
+    sysmem_freeptr(file);
+}
+
+/**
+ * Decode one frame of a file into the layout the cache uses (bins magnitudes/reals, then bins phases/imaginaries)
+ * Only called from the prefetcher, as it reads the mapping. Bins an SDIF frame doesn't have are decoded as 0.
+ * 1TRC amplitudes are scaled by half the FFT size (the number of bins pfft~ passes), which is the magnitude an unwindowed FFT gives a sinusoid.
+ */
+void decodeFrame(t_framefile *file, long frame, float *out) {
+    long bins = file->bins;
+    if (file->format == FILE_NBSF) {
+        memcpy(out, file->data + frame * bins * 2, bins * 2 * sizeof(float));
+        return;
+    }
+    
+    const t_sdifframe *f = file->index + frame;
+    const unsigned char *values = (const unsigned char *)file->map + f->offset;
+    size_t rowBytes = (size_t)f->cols * f->size;
+    float *re = out;
+    float *im = out + bins;
+    if (file->format == FILE_SDIF_STF) {
+        long rows = MIN((long)f->rows, bins);
+        for (long r = 0; r < rows; r++) {
+            re[r] = readSdifValue(values + r*rowBytes, f->size);
+            im[r] = readSdifValue(values + r*rowBytes + f->size, f->size);
+        }
+        memset(re + rows, 0, sizeof(float) * (bins - rows));
+        memset(im + rows, 0, sizeof(float) * (bins - rows));
+    } else {
+        memset(out, 0, sizeof(float) * bins * 2);
+        for (long r = 0; r < (long)f->rows; r++) {
+            const unsigned char *row = values + r*rowBytes;
+            double frequency = readSdifValue(row + f->size, f->size);
+            double amplitude = readSdifValue(row + 2*f->size, f->size) * file->trcScale;
+            double phase = readSdifValue(row + 3*f->size, f->size);
+            long bin = lround(frequency * file->binsPerHz);
+            if (bin >= 0 && bin < bins) {
+                re[bin] += amplitude * cos(phase);
+                im[bin] += amplitude * sin(phase);
+            }
+        }
+    }
+    if (!file->cartesian) {
+        for (long i = 0; i < bins; i++) {
+            double mag = hypot(re[i], im[i]);
+            im[i] = atan2(im[i], re[i]);
+            re[i] = mag;
+        }
+    }
+}
+
+/**
+ * Replace the object's frame file (NULL to remove it) and close the old one once the perform method is done with it
+ * Called on the main thread only.
+ */
+void swapFrameFile(t_interp *x, t_framefile *file) {
+    t_framefile *old = atomic_exchange(&x->frameFile, file);
+    if (!old)
+        return;
+    // The perform method and the prefetcher set their busy flags before they load frameFile, so once both are clear
+    // nothing can still be reading the old file
+    while (atomic_load(&x->fileBusy) || atomic_load(&x->prefetchBusy))
+        systhread_sleep(1);
+    closeFrameFile(old);
+}
+
+/**
+ * Prefetch thread
+ * Keeps the frames from the play position onwards decoded in the frame cache until the object is freed.
+ */
+void *interp_prefetch(t_interp *x) {
+    while (!atomic_load(&x->prefetchQuit)) {
+        atomic_store(&x->prefetchBusy, 1);
+        t_framefile *file = atomic_load(&x->frameFile);
+        if (file)
+            prefetchFrames(file, atomic_load(&x->fileWanted));
+        atomic_store(&x->prefetchBusy, 0);
+        systhread_sleep(PREFETCH_INTERVAL);
+    }
+    systhread_exit(0);
+    return NULL;
+}
+
+/**
+ * Decode the FRAME_CACHE_LOOKAHEAD frames starting at wanted into the cache, evicting the least recently used frames outside that window
+ */
+void prefetchFrames(t_framefile *file, long wanted) {
+    long ahead = MIN(FRAME_CACHE_LOOKAHEAD, file->frames);
+    
+    for (long i = 0; i < ahead; i++) {
+        long frame = (wanted + i) % file->frames;
+        if (findCachedFrame(file, frame) >= 0)
+            continue;
+        
+        // Pick an empty slot, or else the least recently used one outside the lookahead window
+        int victim = -1;
+        unsigned long oldest = ULONG_MAX;
+        for (int s = 0; s < FRAME_CACHE_SLOTS; s++) {
+            t_frameslot *slot = file->slots + s;
+            int state = atomic_load(&slot->state);
+            if (state == SLOT_EMPTY) {
+                victim = s;
+                break;
+            }
+            long distance = (atomic_load(&slot->frame) - wanted + file->frames) % file->frames;
+            unsigned long used = atomic_load_explicit(&slot->lastUsed, memory_order_relaxed);
+            if (state == SLOT_READY && distance >= ahead && s != atomic_load(&file->pinned) && used < oldest) {
+                victim = s;
+                oldest = used;
+            }
+        }
+        if (victim < 0)
+            return;
+        
+        // Claim the slot, then back off if the perform method pinned it in the meantime.
+        // (The perform method pins before checking the state, so one of the two always sees the other.)
+        t_frameslot *slot = file->slots + victim;
+        atomic_store(&slot->state, SLOT_LOADING);
+        if (atomic_load(&file->pinned) == victim) {
+            atomic_store(&slot->state, SLOT_READY);
+            return;
+        }
+        decodeFrame(file, frame, slot->data);
+        atomic_store(&slot->frame, frame);
+        atomic_store(&slot->state, SLOT_READY);
+    }
+}
+
+/**
+ * Open an SDIF file for the output and start the thread that writes it
+ * @return the recording, or NULL if the file couldn't be opened
+ */
+t_recorder *startRecording(t_interp *x, const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        object_error((t_object *)x, "record: can't open %s for writing", path);
+        return NULL;
+    }
+    unsigned char header[SDIF_HEADER_SIZE];
+    memcpy(header, SDIF_MAGIC, 4);
+    writeBig32(header + 4, 8);
+    writeBig32(header + 8, 3);      // SDIF specification version
+    writeBig32(header + 12, 1);     // Standard types version
+    
+    t_recorder *r = (t_recorder *)sysmem_newptrclear(sizeof(t_recorder));
+    if (!r) {
+        object_error((t_object *)x, "record: out of memory");
+        fclose(fp);
+        return NULL;
+    }
+    r->file = fp;
+    r->bins = x->spectrumBins;
+    r->slots = MAX(MIN_RECORD_FRAMES, RECORD_BUFFER_BYTES / (r->bins * 2 * sizeof(float)));
+    r->ring = (float *)sysmem_newptr(sizeof(float) * r->bins * 2 * r->slots);
+    r->times = (double *)sysmem_newptrclear(sizeof(double) * r->slots);
+    r->polar = (char *)sysmem_newptrclear(r->slots);
+    r->hopTime = (double)x->hopSize / x->sampleRate;
+    r->windowTime = (double)x->fftSize / x->sampleRate;
+    r->fftSize = x->fftSize;
+    atomic_init(&r->write, 0);
+    atomic_init(&r->read, 0);
+    atomic_init(&r->stop, 0);
+    if (!r->ring || !r->times || !r->polar || fwrite(header, 1, SDIF_HEADER_SIZE, fp) != SDIF_HEADER_SIZE
+        || systhread_create((method)interp_recordwriter, r, 0, 0, 0, &r->thread) != 0) {
+        object_error((t_object *)x, "record: couldn't start recording to %s", path);
+        fclose(fp);
+        if (r->ring)
+            sysmem_freeptr(r->ring);
+        if (r->times)
+            sysmem_freeptr(r->times);
+        if (r->polar)
+            sysmem_freeptr(r->polar);
+        sysmem_freeptr(r);
+        return NULL;
+    }
+    return r;
+}
+
+/**
+ * Stop the current recording (if any), once the frames still in the ring have been written
+ * Called on the main thread only.
+ */
+void stopRecording(t_interp *x) {
+    t_recorder *r = atomic_exchange(&x->recorder, NULL);
+    if (!r)
+        return;
+    // Same handshake as swapFrameFile: once recordBusy is clear the perform method can't still be filling the ring
+    while (atomic_load(&x->recordBusy))
+        systhread_sleep(1);
+    // The frame being filled is only completed by the next frame boundary, so complete it here (bins it hasn't reached yet are 0)
+    if (r->filling && r->seen > 0) {
+        unsigned long write = atomic_load(&r->write);
+        float *mag = r->ring + (write % r->slots) * r->bins * 2;
+        memset(mag + r->seen, 0, sizeof(float) * (r->bins - r->seen));
+        memset(mag + r->bins + r->seen, 0, sizeof(float) * (r->bins - r->seen));
+        atomic_store(&r->write, write + 1);
+    }
+    unsigned int ret;
+    atomic_store(&r->stop, 1);
+    systhread_join(r->thread, &ret);
+    if (fclose(r->file) != 0 || r->failed)
+        object_error((t_object *)x, "record: couldn't write all of the recording");
+    sysmem_freeptr(r->ring);
+    sysmem_freeptr(r->times);
+    sysmem_freeptr(r->polar);
+    sysmem_freeptr(r);
+}
+
+/**
+ * Record writer thread
+ * Appends the frames the perform method completes to the file until the recording is stopped.
+ */
+void *interp_recordwriter(t_recorder *r) {
+    for (;;) {
+        int stop = atomic_load(&r->stop);
+        unsigned long read = atomic_load_explicit(&r->read, memory_order_relaxed);
+        unsigned long write = atomic_load_explicit(&r->write, memory_order_acquire);
+        for (; read != write; read++) {
+            if (!r->failed && !writeSdifFrame(r, read % r->slots))
+                r->failed = 1;
+            atomic_store_explicit(&r->read, read + 1, memory_order_release);
+        }
+        if (stop)
+            break;
+        systhread_sleep(RECORD_INTERVAL);
+    }
+    systhread_exit(0);
+    return NULL;
+}
+
+/**
+ * Append the frame in one ring slot to the file as an SDIF 1STF frame (an ISTF matrix followed by a float32 1STF matrix)
+ * The ISTF matrix gives the FFT size and hop of the pfft~ the object is in (or the object's FFT size outside pfft~).
+ * @return 1 if the frame was written
+ */
+int writeSdifFrame(t_recorder *r, long slot) {
+    const float *mag = r->ring + slot * r->bins * 2;
+    const float *phase = mag + r->bins;
+    unsigned char header[SDIF_FRAME_HEADER_SIZE + SDIF_MATRIX_HEADER_SIZE + 3*8 + SDIF_MATRIX_HEADER_SIZE];
+    unsigned char *p = header;
+    
+    memcpy(p, "1STF", 4);
+    writeBig32(p + 4, sizeof(header) - 8 + r->bins * 2 * sizeof(float));
+    writeBigDouble(p + 8, r->times[slot]);
+    writeBig32(p + 16, 0);              // Stream ID
+    writeBig32(p + 20, 2);              // Matrix count
+    p += SDIF_FRAME_HEADER_SIZE;
+    memcpy(p, "ISTF", 4);
+    writeBig32(p + 4, SDIF_FLOAT64);
+    writeBig32(p + 8, 1);
+    writeBig32(p + 12, 3);
+    writeBigDouble(p + 16, r->hopTime);                 // DFT period
+    writeBigDouble(p + 24, r->windowTime);              // Window duration
+    writeBigDouble(p + 32, r->fftSize);                 // FFT size
+    p += SDIF_MATRIX_HEADER_SIZE + 3*8;
+    memcpy(p, "1STF", 4);
+    writeBig32(p + 4, SDIF_FLOAT32);
+    writeBig32(p + 8, r->bins);
+    writeBig32(p + 12, 2);
+    if (fwrite(header, 1, sizeof(header), r->file) != sizeof(header))
+        return 0;
+    
+    // Each row is 8 bytes, so the matrix never needs padding
+    unsigned char rows[256 * 8];
+    for (long first = 0; first < r->bins; first += 256) {
+        long count = MIN(256, r->bins - first);
+        for (long i = 0; i < count; i++) {
+            double re = mag[first+i];
+            double im = phase[first+i];
+            if (r->polar[slot]) {
+                re = mag[first+i] * cos(phase[first+i]);
+                im = mag[first+i] * sin(phase[first+i]);
+            }
+            union { float f; uint32_t i; } ur = { (float)re }, ui = { (float)im };
+            writeBig32(rows + i*8, ur.i);
+            writeBig32(rows + i*8 + 4, ui.i);
+        }
+        if (fwrite(rows, 8, count, r->file) != (size_t)count)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Copy the output of one signal vector into the record ring. Only called from the perform method.
+ * Each frame boundary completes the frame being filled and claims the next slot; if the writer hasn't
+ * caught up there is no free slot, so the whole frame is dropped and logged.
+ */
+void recordVector(t_interp *x, t_recorder *r, double *in_index, double *out_mag, double *out_phase, long n) {
+    unsigned long write = atomic_load_explicit(&r->write, memory_order_relaxed);
+    if ((long)in_index[0] == 0) {
+        if (r->filling)
+            atomic_store_explicit(&r->write, ++write, memory_order_release);
+        r->filling = (write - atomic_load_explicit(&r->read, memory_order_acquire) < (unsigned long)r->slots);
+        r->seen = 0;
+        if (r->filling) {
+            r->times[write % r->slots] = r->frames * r->hopTime;
+            r->polar[write % r->slots] = !x->cartesian;
+        } else {
+            logEvent(x, EVENT_RECORD_DROP, r->frames);
+        }
+        r->frames++;
+    }
+    if (!r->filling)
+        return;
+    
+    float *mag = r->ring + (write % r->slots) * r->bins * 2;
+    float *phase = mag + r->bins;
+    for (long k = 0; k < n; k++) {
+        long bin = (long)in_index[k];
+        if (bin >= 0 && bin < r->bins) {
+            mag[bin] = out_mag[k];
+            phase[bin] = out_phase[k];
+            r->seen = MAX(r->seen, bin + 1);
+        }
+    }
+}
+
+/**
+ * List the regions of state that make up a checkpoint: everything the output depends on, including the random number generator
+ * and the file position. Optional modes only contribute their state if they have been switched on.
+ * @param regions room for CHECKPOINT_REGIONS regions
+ * @return the number of regions
+ */
+int listRegions(t_interp *x, t_region *regions) {
+    int n = 0;
+#define REGION(tag, field) regions[n++] = (t_region){tag, &x->field, sizeof(x->field)}
+#define ARRAY(tag, array, size) regions[n++] = (t_region){tag, x->array, (size)}
+    REGION("rng ", rngState);
+    REGION("fnum", frameNumber);
+    REGION("silf", silentFrames);
+    REGION("slep", sleeping);
+    REGION("inpk", inPeak);
+    REGION("outp", outPeak);
+    REGION("play", playing);
+    REGION("fpos", filePosition);
+    REGION("cart", cartesian);
+    REGION("snpf", snapFilled);
+    REGION("snpc", snapCapture);
+    REGION("snpr", snapRequest);
+    REGION("mrph", morphing);
+    REGION("mrpp", morphPending);
+    REGION("mrpn", morphNext);
+    REGION("mrpw", morphWeights);
+    REGION("mrpi", morphInc);
+    REGION("mrpf", morphFrames);
+    REGION("rstw", restWheel);
+    ARRAY("stat", stateBlock, x->stateSize);
+    if (x->fadeMag) {
+        ARRAY("fdmg", fadeMag, sizeof(double) * x->fftSize);
+        ARRAY("fdph", fadePhase, sizeof(double) * x->fftSize);
+        ARRAY("fdim", fadeIncMag, sizeof(double) * x->fftSize);
+        ARRAY("fdip", fadeIncPhase, sizeof(double) * x->fftSize);
+        ARRAY("fdct", fadeCount, sizeof(long) * x->fftSize);
+    }
+    if (x->restAwake) {
+        ARRAY("rsta", restAwake, sizeof(uint64_t) * ((x->fftSize + 63) / 64));
+        ARRAY("rstf", wakeFrame, sizeof(long) * x->fftSize);
+        ARRAY("rstn", restNext, sizeof(int32_t) * x->fftSize);
+    }
+    if (x->currAbs) {
+        ARRAY("cabs", currAbs, sizeof(double) * x->fftSize);
+        ARRAY("iabs", incAbs, sizeof(double) * x->fftSize);
+    }
+    if (x->snapMag) {
+        ARRAY("snpm", snapMag, sizeof(double) * x->fftSize * MAX_SNAPSHOTS);
+        ARRAY("snpp", snapPhase, sizeof(double) * x->fftSize * MAX_SNAPSHOTS);
+    }
+    if (x->snapMagHalf) {
+        ARRAY("snhm", snapMagHalf, sizeof(uint16_t) * x->fftSize * MAX_SNAPSHOTS);
+        ARRAY("snhp", snapPhaseHalf, sizeof(uint16_t) * x->fftSize * MAX_SNAPSHOTS);
+    }
+    if (x->bands)
+        ARRAY("band", bands, sizeof(t_bands));
+    if (x->cepstrum)
+        ARRAY("ceps", cepstrum, sizeof(t_cepstrum));
+#undef REGION
+#undef ARRAY
+    return n;
+}
+
+/**
+ * @return the size of a checkpoint holding the given regions
+ */
+size_t checkpointSize(t_region *regions, int count) {
+    size_t size = sizeof(t_checkpoint_header);
+    for (int i = 0; i < count; i++) {
+        size += sizeof(t_checkpoint_region) + regions[i].size;
+    }
+    return size;
+}
+
+/**
+ * Allocate room for a checkpoint of the current state and start the thread that writes them
+ * @return the checkpointer, or NULL if it couldn't be started
+ */
+t_checkpointer *startCheckpoints(t_interp *x, const char *path, long interval) {
+    t_region regions[CHECKPOINT_REGIONS];
+    int count = listRegions(x, regions);
+    
+    t_checkpointer *cp = (t_checkpointer *)sysmem_newptrclear(sizeof(t_checkpointer));
+    if (!cp) {
+        object_error((t_object *)x, "checkpoint: not enough memory");
+        return NULL;
+    }
+    strncpy_zero(cp->path, path, MAX_PATH_CHARS);
+    cp->interval = interval;
+    cp->capacity = checkpointSize(regions, count);
+    cp->image = (char *)sysmem_newptr(cp->capacity);
+    atomic_init(&cp->size, 0);
+    atomic_init(&cp->stop, 0);
+    if (!cp->image || systhread_create((method)interp_checkpointwriter, cp, 0, 0, 0, &cp->thread) != 0) {
+        object_error((t_object *)x, "checkpoint: couldn't start taking checkpoints to %s", path);
+        if (cp->image)
+            sysmem_freeptr(cp->image);
+        sysmem_freeptr(cp);
+        return NULL;
+    }
+    return cp;
+}
+
+/**
+ * Stop taking checkpoints (if they are being taken), once the one in hand has been written
+ * Called on the main thread only.
+ */
+void stopCheckpoints(t_interp *x) {
+    t_checkpointer *cp = atomic_exchange(&x->checkpointer, NULL);
+    if (!cp)
+        return;
+    // Same handshake as stopRecording
+    while (atomic_load(&x->checkpointBusy))
+        systhread_sleep(1);
+    unsigned int ret;
+    atomic_store(&cp->stop, 1);
+    systhread_join(cp->thread, &ret);
+    if (cp->failed)
+        object_error((t_object *)x, "checkpoint: couldn't write all of the checkpoints to %s", cp->path);
+    sysmem_freeptr(cp->image);
+    sysmem_freeptr(cp);
+}
+
+/**
+ * Checkpoint writer thread
+ * Writes each checkpoint the perform method takes, and grows the image when a checkpoint didn't fit.
+ */
+void *interp_checkpointwriter(t_checkpointer *cp) {
+    for (;;) {
+        int stop = atomic_load(&cp->stop);
+        size_t size = atomic_load_explicit(&cp->size, memory_order_acquire);
+        if (size == SIZE_MAX) {
+            char *image = (char *)sysmem_newptr(cp->needed);
+            if (image) {
+                sysmem_freeptr(cp->image);
+                cp->image = image;
+                cp->capacity = cp->needed;
+            }
+            atomic_store_explicit(&cp->size, 0, memory_order_release);
+        } else if (size) {
+            if (!writeCheckpoint(cp, size))
+                cp->failed = 1;
+            atomic_store_explicit(&cp->size, 0, memory_order_release);
+        }
+        if (stop)
+            break;
+        systhread_sleep(CHECKPOINT_POLL);
+    }
+    systhread_exit(0);
+    return NULL;
+}
+
+/**
+ * Write the checkpoint in hand to a temporary file and rename it over the last one, so the file always holds a complete checkpoint
+ * @return 1 if the checkpoint was written
+ */
+int writeCheckpoint(t_checkpointer *cp, size_t size) {
+    char temp[MAX_PATH_CHARS + 4];
+    snprintf(temp, sizeof(temp), "%s.tmp", cp->path);
+    FILE *fp = fopen(temp, "wb");
+    if (!fp)
+        return 0;
+    int ok = (fwrite(cp->image, 1, size, fp) == size) && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = (fclose(fp) == 0) && ok;
+    if (ok && rename(temp, cp->path) == 0)
+        return 1;
+    remove(temp);
+    return 0;
+}
+
+/**
+ * Copy the state into the checkpoint image and hand it to the writer thread. Only called from the perform method, on a frame boundary.
+ * If the writer is still busy with the last checkpoint, this one is skipped and logged.
+ * The whole state is copied in one vector, as it has to be taken between two frames, so this is only meant for renders that
+ * don't run in real time: with large FFTs or many modes on, the copy can take the vector over its deadline.
+ */
+void takeCheckpoint(t_interp *x, t_checkpointer *cp) {
+    if (atomic_load_explicit(&cp->size, memory_order_acquire)) {
+        logEvent(x, EVENT_CHECKPOINT_SKIP, x->frameNumber);
+        return;
+    }
+    t_region regions[CHECKPOINT_REGIONS];
+    int count = listRegions(x, regions);
+    size_t size = checkpointSize(regions, count);
+    if (size > cp->capacity) {
+        // A mode has been switched on since the image was allocated
+        cp->needed = size;
+        atomic_store_explicit(&cp->size, SIZE_MAX, memory_order_release);
+        logEvent(x, EVENT_CHECKPOINT_SKIP, x->frameNumber);
+        return;
+    }
+    
+    t_checkpoint_header header = {{0}, CHECKPOINT_VERSION, x->fftSize, x->compact, count, x->frameNumber};
+    memcpy(header.magic, CHECKPOINT_MAGIC, 4);
+    memcpy(cp->image, &header, sizeof(header));
+    char *p = cp->image + sizeof(header);
+    for (int i = 0; i < count; i++) {
+        t_checkpoint_region region = {{0}, 0, regions[i].size};
+        memcpy(region.tag, regions[i].tag, 4);
+        memcpy(p, &region, sizeof(region));
+        memcpy(p + sizeof(region), regions[i].data, regions[i].size);
+        p += sizeof(region) + regions[i].size;
+    }
+    atomic_store_explicit(&cp->size, size, memory_order_release);
+}
+
+/**
+ * Check that a checkpoint holds exactly the regions of state the object has now
+ * @return NULL if it does, or a description of the first difference
+ */
+const char *matchCheckpoint(t_interp *x, const char *image, size_t size) {
+    t_region regions[CHECKPOINT_REGIONS];
+    int count = listRegions(x, regions);
+    t_checkpoint_header header;
+    
+    if (size < sizeof(header))
+        return "not a checkpoint";
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.magic, CHECKPOINT_MAGIC, 4) != 0 || header.version != CHECKPOINT_VERSION)
+        return "not a checkpoint";
+    if (header.fftSize != x->fftSize || header.compact != x->compact)
+        return "FFT size or layout";
+    if (size != checkpointSize(regions, count) || header.regions != count)
+        return "modes switched on";
+    const char *p = image + sizeof(header);
+    for (int i = 0; i < count; i++) {
+        t_checkpoint_region region;
+        memcpy(&region, p, sizeof(region));
+        if (memcmp(region.tag, regions[i].tag, 4) != 0 || region.size != regions[i].size)
+            return regions[i].tag;
+        p += sizeof(region) + region.size;
+    }
+    return NULL;
+}
+
+/**
+ * Restore the state from a checkpoint. Only called from the perform method, at the start of a frame boundary, so the next frame
+ * carries on exactly as the frame after the checkpoint did.
+ */
+void restoreCheckpoint(t_interp *x, t_resume *resume) {
+    // A mode could have been switched on since the resume message checked the file
+    if (matchCheckpoint(x, resume->image, resume->size)) {
+        logEvent(x, EVENT_RESUME_MISMATCH, x->frameNumber);
+        return;
+    }
+    t_region regions[CHECKPOINT_REGIONS];
+    int count = listRegions(x, regions);
+    const char *p = resume->image + sizeof(t_checkpoint_header);
+    for (int i = 0; i < count; i++) {
+        memcpy(regions[i].data, p + sizeof(t_checkpoint_region), regions[i].size);
+        p += sizeof(t_checkpoint_region) + regions[i].size;
+    }
+    x->cacheSlot = -1;
+}
+
+/**
+ * @return the cache slot holding the given frame, or -1 if it isn't cached
+ */
+int findCachedFrame(t_framefile *file, long frame) {
+    for (int s = 0; s < FRAME_CACHE_SLOTS; s++) {
+        if (slotHolds(file, s, frame))
+            return s;
+    }
+    return -1;
+}
+
+/**
+ * @return 1 if the cache slot holds a fully decoded copy of the given frame
+ */
+int slotHolds(t_framefile *file, int slot, long frame) {
+    return atomic_load(&file->slots[slot].state) == SLOT_READY && atomic_load(&file->slots[slot].frame) == frame;
+}
+
+/**
+ * Get a decoded frame from the cache. Only called from the perform method, so this never touches the mapping.
+ * If the frame hasn't been decoded yet, the previous frame is reused (and a cache miss logged).
+ * @return the frame data, or NULL if nothing usable is cached
+ */
+const float *cachedFrame(t_interp *x, t_framefile *file, long frame) {
+    int slot = x->cacheSlot;
+    if (slot >= 0 && x->cacheFrame == frame && atomic_load(&file->pinned) == slot && slotHolds(file, slot, frame))
+        return file->slots[slot].data;
+    
+    slot = findCachedFrame(file, frame);
+    if (slot >= 0) {
+        atomic_store(&file->pinned, slot);
+        if (slotHolds(file, slot, frame)) {
+            x->cacheSlot = slot;
+            x->cacheFrame = frame;
+            atomic_store_explicit(&file->slots[slot].lastUsed, ++x->cacheTick, memory_order_relaxed);
+            return file->slots[slot].data;
+        }
+    }
+    
+    logEvent(x, EVENT_CACHE_MISS, frame);
+    slot = x->cacheSlot;
+    if (slot >= 0) {
+        atomic_store(&file->pinned, slot);
+        if (slotHolds(file, slot, x->cacheFrame))
+            return file->slots[slot].data;
+    }
+    x->cacheSlot = -1;
+    atomic_store(&file->pinned, -1);
+    return NULL;
+}
+
+/**
+ * Read the bins of one decoded file frame needed by the current signal vector
+ * Bins the file doesn't have are read as 0.
+ */
+void readFileFrame(const float *frame, long bins, double *in_index, double *mag, double *phase, long n) {
+    const float *fileMag = frame;
+    const float *filePhase = frame + bins;
+    long first = (long)in_index[0];
+    
+    if (first >= 0 && first + n <= bins && (long)in_index[n-1] == first + n - 1) {
+        for (long k = 0; k < n; k++) {
+            mag[k] = fileMag[first+k];
+            phase[k] = filePhase[first+k];
+        }
+    } else {
+        for (long k = 0; k < n; k++) {
+            long bin = (long)in_index[k];
+            int inFile = (bin >= 0 && bin < bins);
+            mag[k] = inFile ? fileMag[bin] : 0;
+            phase[k] = inFile ? filePhase[bin] : 0;
+        }
+    }
+}
+
+/**
+ * Fast reciprocal square root
+ * Bit-level initial guess refined with two Newton-Raphson steps (relative error below 5e-6), written without branches or
+ * library calls so loops using it vectorize.
+ */
+static inline double fastRsqrt(double v) {
+    union { double d; uint64_t i; } u = { v };
+    u.i = 0x5FE6EB50C7B537A9ULL - (u.i >> 1);
+    double y = u.d;
+    y = y * (1.5 - 0.5 * v * y * y);
+    y = y * (1.5 - 0.5 * v * y * y);
+    return y;
+}
+
+/**
+ * Rescale each complex value in place so its magnitude matches mag
+ * Values with (almost) no power have no direction to rescale along and are left alone.
+ */
+void preserveMagnitude(double *re, double *im, const double *mag, long n) {
+    for (long k = 0; k < n; k++) {
+        double power = re[k]*re[k] + im[k]*im[k];
+        double scale = (power > MIN_CARTESIAN_POWER) ? mag[k] * fastRsqrt(power) : 1.;
+        re[k] *= scale;
+        im[k] *= scale;
+    }
+}
+
+/**
+ * Start gliding the snapshot weights towards the ones requested by the last morph message
+ * If we weren't morphing already, jump straight to the new weights.
+ */
+void startMorph(t_interp *x) {
+    x->morphPending = 0;
+    if (!x->morphing) {
+        for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+            x->morphWeights[i] = x->morphNext[i];
+            x->morphInc[i] = 0;
+        }
+        x->morphFrames = 0;
+        x->morphing = 1;
+        return;
+    }
+    long frames = irand(x, x->interpMin, x->interpMax);
+    for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+        x->morphInc[i] = (x->morphNext[i] - x->morphWeights[i]) / frames;
+    }
+    x->morphFrames = frames;
+}
+
+/**
+ * Advance the snapshot weights by one frame, landing exactly on the requested weights at the end of the glide
+ */
+void advanceMorph(t_interp *x) {
+    if (x->morphFrames <= 0)
+        return;
+    if (--x->morphFrames == 0) {
+        for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+            x->morphWeights[i] = x->morphNext[i];
+        }
+    } else {
+        for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+            x->morphWeights[i] += x->morphInc[i];
+        }
+    }
+}
+
+/**
+ * Write the weighted sum of the stored snapshots to the output vectors
+ * Snapshots are accumulated four at a time so the inner loop stays a straight multiply-add over contiguous memory that the compiler can vectorize.
+ * Slots with a zero weight are skipped entirely.
+ */
+void blendSnapshots(t_interp *x, double *in_index, double *out_mag, double *out_phase, long n) {
+    long size = x->fftSize;
+    long first = CLAMP((long)in_index[0], 0, size-1);
+    const double *mag[MAX_SNAPSHOTS];
+    const double *phase[MAX_SNAPSHOTS];
+    double w[MAX_SNAPSHOTS];
+    int count = 0;
+    
+    if (x->compact) {
+        // The weights are linear, so the half scale comes off once at the end
+        const uint16_t *magHalf[MAX_SNAPSHOTS];
+        const uint16_t *phaseHalf[MAX_SNAPSHOTS];
+        for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+            if (x->morphWeights[i] != 0) {
+                magHalf[count] = x->snapMagHalf + i*size;
+                phaseHalf[count] = x->snapPhaseHalf + i*size;
+                w[count] = x->morphWeights[i] * x->halfUnscale;
+                count++;
+            }
+        }
+        for (long k = 0; k < n; k++) {
+            long bin = CLAMP((long)in_index[k], 0, size-1);
+            double m = 0, p = 0;
+            for (int j = 0; j < count; j++) {
+                m += w[j] * halfToFloat(magHalf[j][bin]);
+                p += w[j] * halfToFloat(phaseHalf[j][bin]);
+            }
+            out_mag[k] = m;
+            out_phase[k] = p;
+        }
+        return;
+    }
+    
+    for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+        if (x->morphWeights[i] != 0) {
+            mag[count] = x->snapMag + i*size;
+            phase[count] = x->snapPhase + i*size;
+            w[count] = x->morphWeights[i];
+            count++;
+        }
+    }
+    
+    // pfft~ and fftin~ always hand us consecutive bins. Fall back to a per-sample gather if that isn't the case.
+    if (first + n > size || (long)in_index[n-1] != first + n - 1) {
+        for (long k = 0; k < n; k++) {
+            long bin = CLAMP((long)in_index[k], 0, size-1);
+            double m = 0, p = 0;
+            for (int j = 0; j < count; j++) {
+                m += w[j] * mag[j][bin];
+                p += w[j] * phase[j][bin];
+            }
+            out_mag[k] = m;
+            out_phase[k] = p;
+        }
+        return;
+    }
+    
+    for (long k = 0; k < n; k++) {
+        out_mag[k] = 0;
+        out_phase[k] = 0;
+    }
+    int j = 0;
+    for (; j+4 <= count; j += 4) {
+        const double *m0 = mag[j]+first, *m1 = mag[j+1]+first, *m2 = mag[j+2]+first, *m3 = mag[j+3]+first;
+        const double *p0 = phase[j]+first, *p1 = phase[j+1]+first, *p2 = phase[j+2]+first, *p3 = phase[j+3]+first;
+        double w0 = w[j], w1 = w[j+1], w2 = w[j+2], w3 = w[j+3];
+        for (long k = 0; k < n; k++) {
+            out_mag[k] += w0*m0[k] + w1*m1[k] + w2*m2[k] + w3*m3[k];
+            out_phase[k] += w0*p0[k] + w1*p1[k] + w2*p2[k] + w3*p3[k];
+        }
+    }
+    for (; j < count; j++) {
+        const double *m0 = mag[j]+first, *p0 = phase[j]+first;
+        double w0 = w[j];
+        for (long k = 0; k < n; k++) {
+            out_mag[k] += w0*m0[k];
+            out_phase[k] += w0*p0[k];
+        }
+    }
+}
+
+/**
+ * Get the fft size from a pfft~ object containing nb.binterpolate~
+ * Use the size given as the third argument (or the default FFT size) if nb.binterpolate~ is not inside a pfft~ object
+ * @param requested FFT size from the object's arguments, or 0 if there was none. Any size between MIN_FFT_SIZE and MAX_FFT_SIZE is allowed.
+ * pfft~ only publishes itself through __pfft~__ while its subpatch is being loaded, so this must only be called from interp_new
+ * (object creation always happens on the main thread, even when poly~ runs its voices in parallel).
+ */
+long getFFTSize(t_interp *x, long requested) {
+    t_pfftpub *pfft = (t_pfftpub*)gensym("__pfft~__")->s_thing;
+    if (pfft)
+        return pfft->x_fftsize;
+    else if (requested > 0)
+        return CLAMP(requested, MIN_FFT_SIZE, MAX_FFT_SIZE);
+    else
+        return DEFAULT_FFT_SIZE;
+}
+
+/**
+ * @return number of frames
+ */
+int secondsToFrames(float seconds, int sampleRate, long fftSize) {
+    return (int)((seconds * sampleRate) / fftSize);
+}
+
+/**
+ * Set the minimum and maximum interpolation times that will be randomly chosen in the perform method.
+ */
+void setInterpolationTime(t_interp *x, float interpLengthSecs, float interpVarianceSecs) {
+    // Set the base interpolation length in both seconds and frames
+    x->interpLengthSecs = CLAMP(interpLengthSecs, MIN_LENGTH, MAX_LENGTH);
+    x->interpLengthFrames = secondsToFrames(x->interpLengthSecs, x->sampleRate, x->fftSize);
+    x->interpLengthFrames = (x->interpLengthFrames < MIN_INTERP_FRAMES) ? MIN_INTERP_FRAMES : x->interpLengthFrames;
+    
+    // Set the amount of random variance in both seconds and frames
+    x->interpVarianceSecs = CLAMP(interpVarianceSecs, MIN_VARIANCE, MAX_VARIANCE);
+    x->interpVarianceFrames = secondsToFrames(x->interpVarianceSecs, x->sampleRate, x->fftSize);
+    
+    // Set the min/max frame values
+    double minVar = x->interpLengthFrames-x->interpVarianceFrames;
+    x->interpMin = (minVar <= 0) ? 1 : minVar;
+    x->interpMax = x->interpLengthFrames+x->interpVarianceFrames;
+    atomic_fetch_add_explicit(&x->paramVersion, 1, memory_order_release);
+}
+
+/**
+ * Update the target value for the interpolation using the given magnitude and phase values
+ * @param x pointer to the object struct
+ * @param mag the new magnitude value
+ * @param phase the new phase value
+ * @param bin the fftBin index to update (already clamped to the FFT size)
+ */
+void updateTarget(t_interp *x, t_double mag, t_double phase, long bin) {
+    // Set interpolation target to current signal value for the current fft bin
+    if (fabs(mag) < DENORMAL_THRESHOLD && mag != 0) {
+        mag = 0;
+        x->denormalCount++;
+    }
+    if (fabs(phase) < DENORMAL_THRESHOLD && phase != 0) {
+        phase = 0;
+        x->denormalCount++;
+    }
+    long frames = irand(x, x->interpMin, x->interpMax);
+    if (x->compact) {
+        // Glide to the value that was actually stored so the bin doesn't jump when it reaches the target
+        x->targetMagHalf[bin] = packHalf(x, mag);
+        x->targetPhaseHalf[bin] = packHalf(x, phase);
+        mag = unpackHalf(x, x->targetMagHalf[bin]);
+        phase = unpackHalf(x, x->targetPhaseHalf[bin]);
+        frames = MIN(frames, MAX_COMPACT_FRAMES);
+        x->framesLeft[bin] = frames;
+    } else {
+        x->targetMag[bin] = mag;
+        x->targetPhase[bin] = phase;
+        x->totalFrames[bin] = frames;
+        x->frameCount[bin] = 0;
+    }
+    
+    // Calculate how much to increment the current bin each frame
+    double incM = (mag - x->currMag[bin]) / frames;
+    double incP = (phase - x->currPhase[bin]) / frames;
+    if (fabs(incM) < DENORMAL_THRESHOLD && incM != 0) {
+        incM = 0;
+        x->denormalCount++;
+    }
+    if (fabs(incP) < DENORMAL_THRESHOLD && incP != 0) {
+        incP = 0;
+        x->denormalCount++;
+    }
+    x->incMag[bin] = incM;
+    x->incPhase[bin] = incP;
+    
+    // In cartesian mode the magnitude glides on its own, from the magnitude of the old target to the magnitude of the new one
+    if (x->cartesian) {
+        x->currAbs[bin] = hypot(x->currMag[bin], x->currPhase[bin]);
+        x->incAbs[bin] = (hypot(mag, phase) - x->currAbs[bin]) / frames;
+    }
+    
+    // Reset updateTarget flag
+    x->updateTarget[bin] = 0;
+}
+
+/**
+ * Send a bin that has just reached its target to rest for a random number of frames
+ * The bin keeps its updateTarget flag, so it retargets as soon as it wakes up.
+ */
+void startRest(t_interp *x, long bin) {
+    // Let a crossfade finish first, otherwise the output would jump to the resting value
+    if (x->overlapFrames && x->fadeCount[bin] > 0)
+        return;
+    if (!(x->restAwake[bin >> 6] & (1ULL << (bin & 63))))
+        return; // Already resting (the same bin came up twice in one vector)
+    int frames = irand(x, 0, x->restFrames);
+    if (frames <= 0)
+        return;
+    long wake = x->frameNumber + frames;
+    int slot = wake & (REST_WHEEL_SIZE-1);
+    x->wakeFrame[bin] = wake;
+    x->restNext[bin] = x->restWheel[slot];
+    x->restWheel[slot] = (int32_t)bin;
+    x->restAwake[bin >> 6] &= ~(1ULL << (bin & 63));
+}
+
+/**
+ * Wake the bins whose rest ends in the current frame
+ * Only the wheel slot for this frame is visited. Bins in it that rest for more than REST_WHEEL_SIZE frames go back in the same slot.
+ */
+void wakeRested(t_interp *x) {
+    int slot = x->frameNumber & (REST_WHEEL_SIZE-1);
+    int32_t bin = x->restWheel[slot];
+    x->restWheel[slot] = -1;
+    while (bin >= 0) {
+        int32_t next = x->restNext[bin];
+        if (x->wakeFrame[bin] <= x->frameNumber) {
+            x->restAwake[bin >> 6] |= 1ULL << (bin & 63);
+        } else {
+            x->restNext[bin] = x->restWheel[slot];
+            x->restWheel[slot] = bin;
+        }
+        bin = next;
+    }
+}
+
+/**
+ * Wake every resting bin, once rest has been switched off
+ * Once the bins are awake the wheel is empty, so after that this only checks the wheel.
+ */
+void wakeAllRested(t_interp *x) {
+    char resting = 0;
+    for (int i = 0; i < REST_WHEEL_SIZE; i++) {
+        resting |= (x->restWheel[i] >= 0);
+        x->restWheel[i] = -1;
+    }
+    if (resting)
+        memset(x->restAwake, 0xff, sizeof(uint64_t) * ((x->fftSize + 63) / 64));
+}
+
+/**
+ * Find the next bin that isn't resting
+ * @param awake the restAwake bits
+ * @param first the bin at the start of the vector
+ * @param k the position in the vector to start looking from
+ * @param n the vector size
+ * @return the position of the next awake bin in the vector, or n if there are none left
+ */
+static inline long nextAwake(const uint64_t *awake, long first, long k, long n) {
+    long bin = first + k;
+    long end = first + n;
+    while (bin < end) {
+        uint64_t word = awake[bin >> 6] >> (bin & 63);
+        if (word)
+            return MIN(bin + __builtin_ctzll(word), end) - first;
+        bin = (bin | 63) + 1;
+    }
+    return n;
+}
+
+/**
+ * Split the bins that arrive each frame into log-spaced bands. The glides start from the levels of the first complete frame.
+ * Called by the perform method on a frame boundary. advanceBands lays the bands out again if a different number of bins turns up.
+ */
+void setupBands(t_interp *x, int count) {
+    t_bands *bands = x->bands;
+    bands->count = count;
+    bands->seen = 0;
+    if (!count)
+        return;
+    layoutBands(bands, x->spectrumBins);
+    for (int b = 0; b < count; b++) {
+        bands->curr[b] = 0;
+        bands->inc[b] = 0;
+        bands->left[b] = 0;
+        bands->live[b] = 0;
+        bands->energy[b] = 0;
+    }
+}
+
+/**
+ * Work out the band edges for a number of bins, and have the levels measured again over the new bands
+ * Each band gets at least one bin while there are enough, so the lowest bands are one bin wide.
+ * The input is passed through unchanged until the levels have been measured.
+ */
+void layoutBands(t_bands *bands, long bins) {
+    int count = bands->count;
+    bands->bins = bins;
+    bands->measuring = 1;
+    bands->edge[0] = 0;
+    for (int b = 1; b < count; b++) {
+        long edge = (long)ceil(pow((double)bins, (double)b / count));
+        bands->edge[b] = MAX(CLAMP(edge, bands->edge[b-1] + 1, bins - (count - b)), bands->edge[b-1]);
+    }
+    bands->edge[count] = bins;
+    for (int b = 0; b < count; b++) {
+        bands->ratio[b] = 1;
+    }
+}
+
+/**
+ * Advance the band glides by one frame
+ * Takes the levels measured over the frame that just finished, steps each band towards its target, retargets the bands that have
+ * arrived and works out the gains for the next frame.
+ */
+void advanceBands(t_interp *x) {
+    t_bands *bands = x->bands;
+    // Inside pfft~ only half the spectrum comes through, so the bands are spread over the bins actually seen
+    long bins = bands->seen;
+    bands->seen = 0;
+    if (!bins)
+        return; // Just set up, nothing measured yet
+    if (bins != bands->bins) {
+        // The levels were measured over the wrong bands, so start again with the right ones
+        layoutBands(bands, bins);
+        for (int b = 0; b < bands->count; b++) {
+            bands->energy[b] = 0;
+        }
+        return;
+    }
+    for (int b = 0; b < bands->count; b++) {
+        bands->live[b] = sqrt(bands->energy[b] / MAX(bands->edge[b+1] - bands->edge[b], 1));
+        bands->energy[b] = 0;
+        if (bands->measuring) {
+            bands->curr[b] = bands->live[b];
+            bands->left[b] = 0;
+        }
+        
+        // In band mode freeze holds the band levels
+        if (!x->freeze) {
+            if (bands->left[b] <= 0) {
+                long frames = irand(x, x->interpMin, x->interpMax);
+                frames = MAX(frames, 1);
+                bands->inc[b] = (bands->live[b] - bands->curr[b]) / frames;
+                bands->left[b] = frames;
+            }
+            bands->curr[b] += bands->inc[b];
+            bands->left[b]--;
+        }
+        bands->ratio[b] = (bands->live[b] > DENORMAL_THRESHOLD) ? MAX(bands->curr[b], 0) / bands->live[b] : 0;
+    }
+    bands->measuring = 0;
+}
+
+/**
+ * Start cepstrum mode. The glides start from the envelope of the first complete frame.
+ * Called by the perform method on a frame boundary
+ */
+void setupCepstrum(t_interp *x, int count) {
+    t_cepstrum *cep = x->cepstrum;
+    cep->count = count;
+    cep->measuring = 1;
+    cep->bins = 0;
+    cep->seen = 0;
+    for (int q = 0; q < MAX_CEPSTRUM; q++) {
+        cep->curr[q] = 0;
+        cep->inc[q] = 0;
+        cep->left[q] = 0;
+        cep->live[q] = 0;
+        cep->sum[q] = 0;
+        cep->diff[q] = 0;
+    }
+}
+
+/**
+ * Advance the coefficient glides by one frame
+ * Normalizes the DCT accumulated over the frame that just finished, steps each coefficient towards its target, retargets the ones
+ * that have arrived and works out the log envelope correction for the next frame.
+ */
+void advanceCepstrum(t_interp *x) {
+    t_cepstrum *cep = x->cepstrum;
+    // Inside pfft~ only half the spectrum comes through, so the DCT length is the number of bins actually seen
+    long bins = cep->seen;
+    cep->seen = 0;
+    if (!bins)
+        return; // Just set up, nothing measured yet
+    if (bins != cep->bins) {
+        // The sums were taken with the wrong DCT length, so start again with the right one
+        cep->bins = bins;
+        for (int q = 0; q < cep->count; q++) {
+            cep->sum[q] = 0;
+        }
+        return;
+    }
+    for (int q = 0; q < cep->count; q++) {
+        cep->live[q] = cep->sum[q] / cep->bins;
+        cep->sum[q] = 0;
+        if (cep->measuring)
+            cep->curr[q] = cep->live[q];
+        
+        // In cepstrum mode freeze holds the envelope
+        if (!x->freeze) {
+            if (cep->left[q] <= 0) {
+                long frames = irand(x, x->interpMin, x->interpMax);
+                frames = MAX(frames, 1);
+                cep->inc[q] = (cep->live[q] - cep->curr[q]) / frames;
+                cep->left[q] = frames;
+            }
+            cep->curr[q] += cep->inc[q];
+            cep->left[q]--;
+        }
+        
+        // The inverse DCT counts every coefficient but the first twice
+        cep->diff[q] = (q ? 2 : 1) * (cep->curr[q] - cep->live[q]);
+    }
+    cep->measuring = 0;
+}
+
+/**
+ * Find the band a bin belongs to
+ */
+long findBand(const t_bands *bands, long bin) {
+    long lo = 0;
+    long hi = bands->count - 1;
+    while (lo < hi) {
+        long mid = (lo + hi + 1) / 2;
+        if (bands->edge[mid] <= bin)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+/**
+ * Read the target of a bin from whichever layout is in use
+ */
+void loadTarget(t_interp *x, long bin, double *mag, double *phase) {
+    if (x->compact) {
+        *mag = unpackHalf(x, x->targetMagHalf[bin]);
+        *phase = unpackHalf(x, x->targetPhaseHalf[bin]);
+    } else {
+        *mag = x->targetMag[bin];
+        *phase = x->targetPhase[bin];
+    }
+}
+
+/**
+ * Number of frames until a bin reaches its target (at least 1)
+ */
+long remainingFrames(t_interp *x, long bin) {
+    if (x->compact)
+        return MAX(x->framesLeft[bin], 1);
+    return MAX(x->totalFrames[bin] - x->frameCount[bin], 1);
+}
+
+
+//***********************************************************************************************
+// DSP
+//***********************************************************************************************
+/**
+ * Setup DSP, called when audio is activated
+ * Registers the 64-bit perform method in the signal chain in MSP
+ */
+void interp_dsp64(t_interp *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags) {
+    int ok = prepareDsp(x, samplerate, maxvectorsize);
+    for (long i = 0; i < x->variantCount; i++)
+        ok = prepareDsp(x->variants[i], samplerate, maxvectorsize) && ok;
+    if (!ok) {
+        // Leave the object out of the DSP chain (so its outlets are silent) rather than run it without scratch space
+        object_error((t_object *)x, "not enough memory for a vector size of %ld", maxvectorsize);
+        return;
+    }
+
+    object_method(dsp64, gensym("dsp_add64"), x, interp_perform64, 0, NULL);
+}
+
+/**
+ * Get the object (or one of its variants) ready for audio to start
+ * @return 1 on success, 0 if there isn't enough memory for the scratch space
+ */
+int prepareDsp(t_interp *x, double samplerate, long maxvectorsize) {
+    x->sampleRate = samplerate; // Update the sample rate in case it has changed since the object was created
+    
+    // Set updateTarget to true when audio is started so that we get a new interpolation target.
+    for (long i = 0; i<x->fftSize; i++) {
+        x->updateTarget[i] = 1;
+    }
+
+    if (maxvectorsize > x->scratchSize) {
+        if (x->scratch)
+            sysmem_freeptr(x->scratch);
+        x->scratch = (double*)sysmem_newptrclear(sizeof(double) * maxvectorsize * 3);
+        x->scratchSize = x->scratch ? maxvectorsize : 0;
+    }
+    return x->scratch != NULL;
+}
+
+/**
+ * 64-bit audio perform method
+ * Registered once in interp_dsp64. It takes care of everything that happens once per frame (switching kernels, snapshot capture,
+ * file input) and then hands the vector to the current kernel, so changing modes never requires restarting DSP.
+ */
+void interp_perform64(t_interp *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam) {
+    // Input signal vectors
+	t_double *in_mag = ins[0];      // Either the real component of the FFT or the magnitude depending on if the input is in cartesian or polar coordinates
+    t_double *in_phase = ins[1];    // Either the imaginary component of the FFT or the phase depending on the coordinate system
+    t_double *in_index = ins[2];    // The FFT bin index
+    
+    // Output signal vectors
+    t_double *out_mag = outs[0];	// Left outlet - magnitude/real
+    t_double *out_phase = outs[1];  // Right outlet - phase/imaginary
+    
+    long maxBin = x->fftSize-1;
+    double start = x->timing ? monotonicTime() : 0;
+    
+    atomic_store(&x->fileBusy, 1);
+    t_framefile *file = atomic_load(&x->frameFile);
+    
+    // A vector starting at bin 0 is the start of a new frame. Kernels, snapshot captures and weight glides only change on frame boundaries.
+    if ((long)in_index[0] == 0) {
+        // Checkpoints hold the state between two frames, so they are restored and taken before anything else
+        t_resume *resume = atomic_exchange(&x->resumePending, NULL);
+        if (resume) {
+            restoreCheckpoint(x, resume);
+            atomic_store(&x->resumeDone, resume);
+        }
+        atomic_store(&x->checkpointBusy, 1);
+        t_checkpointer *checkpointer = atomic_load(&x->checkpointer);
+        if (checkpointer && x->frameNumber > 0 && x->frameNumber % checkpointer->interval == 0)
+            takeCheckpoint(x, checkpointer);
+        atomic_store(&x->checkpointBusy, 0);
+        if (x->frameTime > 0)
+            finishFrameTiming(x);
+        x->frameNumber++;
+        if (x->restAwake && x->restFrames > 0)
+            wakeRested(x);
+        else if (x->restAwake)
+            wakeAllRested(x);
+        long probe = atomic_load_explicit(&x->probeBin, memory_order_acquire);
+        if (probe >= 0)
+            probeFrame(x, probe);
+        long shadowInterval = atomic_load_explicit(&x->shadowInterval, memory_order_acquire);
+        x->shadowNext = -1;
+        if (shadowInterval > 0)
+            scheduleShadow(x, shadowInterval);
+        long version = atomic_load_explicit(&x->paramVersion, memory_order_acquire);
+        if (version != x->paramSeen) {
+            x->paramSeen = version;
+            logEvent(x, EVENT_PARAMS, x->interpMax);
+        }
+        if (x->playRequest != x->playing) {
+            x->playing = x->playRequest;
+            x->filePosition = -1;
+        }
+        if (x->playing && file) {
+            x->filePosition = (x->filePosition + 1) % file->frames;
+        }
+        
+        // Go idle once the input has been silent for longer than the longest glide (so every bin has a silent target) and the output has died away.
+        // The peaks are only measured while idle detection is on, so silent frames only count from then.
+        if (x->idle && x->inPeak < IDLE_FLOOR) {
+            x->silentFrames++;
+        } else {
+            x->silentFrames = 0;
+        }
+        if (!x->idle) {
+            x->sleeping = 0;
+        } else if (!x->sleeping && x->silentFrames > x->interpMax + x->overlapFrames && x->outPeak < IDLE_FLOOR) {
+            x->sleeping = 1;
+        }
+        x->inPeak = 0;
+        x->outPeak = 0;
+        
+        if (x->snapCapture >= 0) {
+            x->snapFilled[x->snapCapture] = 1;
+            x->snapCapture = -1;
+        }
+        if (x->snapRequest >= 0) {
+            x->snapCapture = x->snapRequest;
+            x->snapRequest = -1;
+        }
+        if (x->cartesianRequest != x->cartesian) {
+            if (x->cartesianRequest)
+                startCartesian(x);
+            else
+                x->cartesian = 0;
+        }
+        // Freeze holds the snapshot weights where they are, and keeps a new morph waiting until it is switched off
+        if (x->morphPending && !x->freeze) {
+            startMorph(x);
+        } else if (x->morphing && !x->freeze) {
+            advanceMorph(x);
+        }
+        if (x->bandRequest != (x->bands ? x->bands->count : 0))
+            setupBands(x, x->bandRequest);
+        if (x->bands && x->bands->count)
+            advanceBands(x);
+        if (x->cepstrumRequest != (x->cepstrum ? x->cepstrum->count : 0))
+            setupCepstrum(x, x->cepstrumRequest);
+        if (x->cepstrum && x->cepstrum->count)
+            advanceCepstrum(x);
+        x->kernel = chooseKernel(x);
+    }
+    if (x->playing && file) {
+        // Take the input from the current file frame instead of the signal inlets
+        long frame = CLAMP(x->filePosition, 0, file->frames-1);
+        const float *data = cachedFrame(x, file, frame);
+        in_mag = x->scratch + x->scratchSize;
+        in_phase = x->scratch + 2*x->scratchSize;
+        if (data) {
+            readFileFrame(data, file->bins, in_index, in_mag, in_phase, sampleframes);
+        } else {
+            memset(in_mag, 0, sizeof(double) * sampleframes);
+            memset(in_phase, 0, sizeof(double) * sampleframes);
+        }
+        atomic_store(&x->fileWanted, (frame + 1) % file->frames);
+    } else {
+        atomic_store(&x->fileWanted, 0); // Have the start of the file ready for the next play message
+    }
+    atomic_store(&x->fileBusy, 0);
+    
+    if (x->snapCapture >= 0 && x->compact) {
+        uint16_t *snapMag = x->snapMagHalf + x->snapCapture*(maxBin+1);
+        uint16_t *snapPhase = x->snapPhaseHalf + x->snapCapture*(maxBin+1);
+        for (long k = 0; k < sampleframes; k++) {
+            long bin = CLAMP((long)in_index[k], 0, maxBin);
+            snapMag[bin] = packHalf(x, in_mag[k]);
+            snapPhase[bin] = packHalf(x, in_phase[k]);
+        }
+    } else if (x->snapCapture >= 0) {
+        double *snapMag = x->snapMag + x->snapCapture*(maxBin+1);
+        double *snapPhase = x->snapPhase + x->snapCapture*(maxBin+1);
+        for (long k = 0; k < sampleframes; k++) {
+            long bin = CLAMP((long)in_index[k], 0, maxBin);
+            snapMag[bin] = in_mag[k];
+            snapPhase[bin] = in_phase[k];
+        }
+    }
+    
+    // shadowNext is -1 unless a shadow check is due in this frame
+    long first = (long)in_index[0];
+    char shadowing = x->shadowNext >= first && x->shadowNext < first + sampleframes && captureShadow(x, in_mag, in_phase, in_index, sampleframes);
+    x->kernel(x, in_mag, in_phase, in_index, out_mag, out_phase, sampleframes);
+    if (shadowing)
+        finishShadow(x, out_mag, out_phase);
+    
+    atomic_store(&x->recordBusy, 1);
+    t_recorder *recorder = atomic_load(&x->recorder);
+    if (recorder)
+        recordVector(x, recorder, in_index, out_mag, out_phase, sampleframes);
+    atomic_store(&x->recordBusy, 0);
+    
+    // The variants take the same input, including frames played from a file
+    double *variantIns[3] = {in_mag, in_phase, in_index};
+    for (long i = 0; i < x->variantCount && 2*i + 3 < numouts; i++) {
+        interp_perform64(x->variants[i], dsp64, variantIns, 3, outs + 2*i + 2, 2, sampleframes, flags, userparam);
+    }
+    if (x->timing)
+        x->frameTime += monotonicTime() - start;
+}
+
+//***********************************************************************************************
+// Kernels
+//***********************************************************************************************
+/**
+ * Publish the kernel selected by the bypass and freeze messages. The perform method switches to it on the next frame boundary.
+ */
+void publishMode(t_interp *x) {
+    t_interp_kernel mode = glideKernel;
+    if (x->bypass)
+        mode = bypassKernel;
+    else if (x->freeze)
+        mode = freezeKernel;
+    atomic_store(&x->modeKernel, mode);
+}
+
+/**
+ * Pick the kernel for the next frame. Bypass and freeze come from the messages; morphing and idling are decided by the perform method.
+ * Band, cepstrum and morph modes freeze inside their own kernels (by holding the band levels, envelope or snapshot weights),
+ * since freezeKernel holds the per-bin glides, which aren't what they output.
+ */
+t_interp_kernel chooseKernel(t_interp *x) {
+    t_interp_kernel mode = atomic_load(&x->modeKernel);
+    char enveloped = (x->bands && x->bands->count) || (x->cepstrum && x->cepstrum->count);
+    if (mode != glideKernel && !(mode == freezeKernel && (enveloped || x->morphing)))
+        return mode;
+    if (x->morphing)
+        return morphKernel;
+    if (x->sleeping)
+        return sleepKernel;
+    return runningKernel(x);
+}
+
+/**
+ * The kernel that does the interpolation: band mode, cepstrum mode or one of the per-bin kernels
+ */
+t_interp_kernel runningKernel(t_interp *x) {
+    if (x->bands && x->bands->count)
+        return bandKernel;
+    if (x->cepstrum && x->cepstrum->count)
+        return cepstrumKernel;
+    return selectGlide(x);
+}
+
+/**
+ * Gain and gate stages, applied to each output bin as it is written
+ * In cartesian mode they act on the magnitude lane, which preserveMagnitude then applies to both outlets.
+ * The kernels that don't glide per bin apply the same stages afterwards with shapeVector.
+ */
+static inline __attribute__((always_inline)) void shapeOutput(const unsigned stages, double gain, double gate, double *mag, double *abs) {
+    double *level = (stages & STAGE_CARTESIAN) ? abs : mag;
+    if ((stages & STAGE_GATE) && fabs(*level) < gate)
+        *level = 0;
+    if (stages & STAGE_GAIN)
+        *level *= gain;
+}
+
+/**
+ * Interpolation kernel body
+ * Retargeting and advancing are fused into a single pass so each bin's state is read once per frame.
+ * (Max hands us one spectral frame per call inside pfft~, so there is no way to batch several frames here.)
+ * Every optional stage is guarded by a bit of stages. The variants below pass a constant, so the compiler drops the stages they don't
+ * use; glideKernel passes the stages that are on at run time and is the fallback for every other combination.
+ */
+static inline __attribute__((always_inline)) void glide(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long sampleframes, const unsigned stages) {
+    // Keep the state pointers in locals so the compiler doesn't reload them through x on every sample
+    double *currMag = x->currMag;
+    double *currPhase = x->currPhase;
+    double *incMag = x->incMag;
+    double *incPhase = x->incPhase;
+    long *totalFrames = x->totalFrames;
+    long *frameCount = x->frameCount;
+    uint16_t *framesLeft = x->framesLeft;
+    char compact = (stages & STAGE_COMPACT) != 0;
+    char *update = x->updateTarget;
+    long maxBin = x->fftSize-1;
+    double *fadeMag = x->fadeMag;
+    double *fadePhase = x->fadePhase;
+    double *fadeIncMag = x->fadeIncMag;
+    double *fadeIncPhase = x->fadeIncPhase;
+    long *fadeCount = x->fadeCount;
+    long overlap = (stages & STAGE_OVERLAP) ? x->overlapFrames : 0;
+    double fadeScale = 1. / (overlap + 1);
+    double *currAbs = x->currAbs;
+    double *incAbs = x->incAbs;
+    double *outAbs = x->scratch;
+    char cartesian = (stages & STAGE_CARTESIAN) != 0;
+    uint64_t *awake = (stages & STAGE_REST) ? x->restAwake : NULL;
+    char rest = awake && x->restFrames > 0;
+    double gain = x->gain;
+    double gate = x->gate;
+    
+    // With rests, when the vector is a run of consecutive bins (always the case inside pfft~) every bin starts out holding its value
+    // and the loop below only visits the bins that are awake
+    long first = (long)in_index[0];
+    char skipResting = awake && sampleframes > 0 && first >= 0 && first + sampleframes - 1 <= maxBin && (long)in_index[sampleframes-1] == first + sampleframes - 1;
+    if (skipResting && (stages & (STAGE_GAIN | STAGE_GATE))) {
+        for (long k = 0; k < sampleframes; k++) {
+            out_mag[k] = currMag[first+k];
+            out_phase[k] = currPhase[first+k];
+            if (cartesian)
+                outAbs[k] = currAbs[first+k];
+            shapeOutput(stages, gain, gate, out_mag+k, outAbs+k);
+        }
+    } else if (skipResting) {
+        memcpy(out_mag, currMag + first, sizeof(double) * sampleframes);
+        memcpy(out_phase, currPhase + first, sizeof(double) * sampleframes);
+        if (cartesian)
+            memcpy(outAbs, currAbs + first, sizeof(double) * sampleframes);
+    }
+    
+    // Only the magnitude matters for silence in polar mode; the phase of a silent bin can be anything
+    if (x->idle) {
+        x->inPeak = vectorPeak(in_mag, sampleframes, x->inPeak);
+        if (cartesian)
+            x->inPeak = vectorPeak(in_phase, sampleframes, x->inPeak);
+    }
+    
+    long retargets = 0;
+    long clamped = 0;
+    double clampedIndex = 0;
+    x->denormalCount = 0;
+    
+    for (long k = 0; k < sampleframes; k++) {
+        if (skipResting) {
+            k = nextAwake(awake, first, k, sampleframes);
+            if (k == sampleframes)
+                break;
+        }
+        
+        // Get the FFT bin index and CLAMP it between 0 and x->fftSize to avoid a segfault if x->fftSize doesn't match the outer fft size.
+        // (Note: This won't occur if the object is used inside a pfft~ object as intended.)
+        long index = skipResting ? first + k : (long)in_index[k];
+        long bin = CLAMP(index, 0, maxBin);
+        if (bin != index) {
+            clamped++;
+            clampedIndex = index;
+        }
+        
+        // Resting bins in a vector that couldn't be skipped hold their value
+        if (awake && !skipResting && !(awake[bin >> 6] & (1ULL << (bin & 63)))) {
+            out_mag[k] = currMag[bin];
+            out_phase[k] = currPhase[bin];
+            if (cartesian)
+                outAbs[k] = currAbs[bin];
+            shapeOutput(stages, gain, gate, out_mag+k, outAbs+k);
+            continue;
+        }
+        
+        if (update[bin]) {
+            retargets++;
+            
+            // Target reached - Set the old target value as the new starting point for interpolation
+            loadTarget(x, bin, currMag+bin, currPhase+bin);
+            
+            // In overlap mode, keep the outgoing glide running on the fade lane so it can be crossfaded into the new one
+            if (overlap) {
+                fadeMag[bin] = currMag[bin];
+                fadePhase[bin] = currPhase[bin];
+                fadeIncMag[bin] = incMag[bin];
+                fadeIncPhase[bin] = incPhase[bin];
+                fadeCount[bin] = overlap;
+            }
+            
+            // Update target with new inputs
+            updateTarget(x, in_mag[k], in_phase[k], bin);
+        }
+        
+        // Add the increment for the current bin and write the updated value to the output channels
+        double mag = currMag[bin] + incMag[bin];
+        double phase = currPhase[bin] + incPhase[bin];
+        currMag[bin] = mag;
+        currPhase[bin] = phase;
+        
+        // Crossfade from the outgoing glide, which carries on at its old slope, to the new glide
+        if (overlap && fadeCount[bin] > 0) {
+            double fadeM = fadeMag[bin] + fadeIncMag[bin];
+            double fadeP = fadePhase[bin] + fadeIncPhase[bin];
+            double w = MIN(fadeCount[bin] * fadeScale, 1.);
+            fadeMag[bin] = fadeM;
+            fadePhase[bin] = fadeP;
+            fadeCount[bin]--;
+            mag += w * (fadeM - mag);
+            phase += w * (fadeP - phase);
+        }
+        out_mag[k] = mag;
+        out_phase[k] = phase;
+        if (cartesian) {
+            double abs = currAbs[bin] + incAbs[bin];
+            currAbs[bin] = abs;
+            outAbs[k] = abs;
+        }
+        shapeOutput(stages, gain, gate, out_mag+k, outAbs+k);
+        
+        // Increment frameCount and set the updateTarget flag to true if the current bin has reached its target
+        if (compact) {
+            unsigned left = framesLeft[bin];
+            if (left <= 1) {
+                update[bin] = 1;
+                left = 1;
+                if (rest)
+                    startRest(x, bin);
+            }
+            framesLeft[bin] = left - 1;
+        } else {
+            long framePos = frameCount[bin]+1;
+            if (framePos >= totalFrames[bin]) {
+                update[bin] = 1;
+                framePos = 0;
+                if (rest)
+                    startRest(x, bin);
+            }
+            frameCount[bin] = framePos;
+        }
+    }
+    if (cartesian)
+        preserveMagnitude(out_mag, out_phase, outAbs, sampleframes);
+    if (x->idle) {
+        x->outPeak = vectorPeak(out_mag, sampleframes, x->outPeak);
+        if (cartesian)
+            x->outPeak = vectorPeak(out_phase, sampleframes, x->outPeak);
+    }
+    
+    if (clamped)
+        logEvent(x, EVENT_CLAMP, clampedIndex);
+    if (retargets > sampleframes * RETARGET_BURST_FRACTION)
+        logEvent(x, EVENT_RETARGET_BURST, retargets);
+    if (x->denormalCount)
+        logEvent(x, EVENT_DENORMAL, x->denormalCount);
+}
+
+/**
+ * The stages that are switched on at the moment
+ */
+unsigned activeStages(t_interp *x) {
+    unsigned stages = 0;
+    if (x->compact)
+        stages |= STAGE_COMPACT;
+    if (x->overlapFrames > 0)
+        stages |= STAGE_OVERLAP;
+    if (x->cartesian)
+        stages |= STAGE_CARTESIAN;
+    if (x->restAwake && x->restFrames > 0)
+        stages |= STAGE_REST;
+    if (x->gain != 1.)
+        stages |= STAGE_GAIN;
+    if (x->gate > 0)
+        stages |= STAGE_GATE;
+    return stages;
+}
+
+/**
+ * Generic interpolation kernel, used for combinations of stages that don't have their own variant
+ */
+void glideKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long sampleframes) {
+    glide(x, in_mag, in_phase, in_index, out_mag, out_phase, sampleframes, activeStages(x));
+}
+
+// Interpolation kernel variants for the common combinations of stages
+#define GLIDE_VARIANT(name, stages) \
+    void name(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long sampleframes) { \
+        glide(x, in_mag, in_phase, in_index, out_mag, out_phase, sampleframes, stages); \
+    }
+GLIDE_VARIANT(glidePlain,               0)
+GLIDE_VARIANT(glideOverlap,             STAGE_OVERLAP)
+GLIDE_VARIANT(glideCartesian,           STAGE_CARTESIAN)
+GLIDE_VARIANT(glideOverlapCartesian,    STAGE_OVERLAP | STAGE_CARTESIAN)
+GLIDE_VARIANT(glideRest,                STAGE_REST)
+GLIDE_VARIANT(glideCompact,             STAGE_COMPACT)
+GLIDE_VARIANT(glideCompactRest,         STAGE_COMPACT | STAGE_REST)
+GLIDE_VARIANT(glideGain,                STAGE_GAIN)
+GLIDE_VARIANT(glideGate,                STAGE_GATE)
+GLIDE_VARIANT(glideGainGate,            STAGE_GAIN | STAGE_GATE)
+
+static const struct {
+    unsigned        stages;
+    t_interp_kernel kernel;
+} glideVariants[] = {
+    { 0,                                glidePlain },
+    { STAGE_OVERLAP,                    glideOverlap },
+    { STAGE_CARTESIAN,                  glideCartesian },
+    { STAGE_OVERLAP | STAGE_CARTESIAN,  glideOverlapCartesian },
+    { STAGE_REST,                       glideRest },
+    { STAGE_COMPACT,                    glideCompact },
+    { STAGE_COMPACT | STAGE_REST,       glideCompactRest },
+    { STAGE_GAIN,                       glideGain },
+    { STAGE_GATE,                       glideGate },
+    { STAGE_GAIN | STAGE_GATE,          glideGainGate },
+};
+
+/**
+ * Pick the interpolation kernel compiled for the stages that are on, or the generic one if there isn't a variant for them
+ */
+t_interp_kernel selectGlide(t_interp *x) {
+    unsigned stages = activeStages(x);
+    for (size_t i = 0; i < sizeof(glideVariants) / sizeof(glideVariants[0]); i++) {
+        if (glideVariants[i].stages == stages)
+            return glideVariants[i].kernel;
+    }
+    return glideKernel;
+}
+
+/**
+ * Idle kernel
+ * Writes zeros while the input stays silent. The first vector with any input switches straight back to the interpolation kernel.
+ */
+void sleepKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long sampleframes) {
+    double peak = vectorPeak(in_mag, sampleframes, 0);
+    if (x->cartesian)
+        peak = vectorPeak(in_phase, sampleframes, peak);
+    
+    if (peak < IDLE_FLOOR) {
+        memset(out_mag, 0, sizeof(double) * sampleframes);
+        memset(out_phase, 0, sizeof(double) * sampleframes);
+        return;
+    }
+    
+    // Wake up and carry on from where the glides settled
+    x->sleeping = 0;
+    x->silentFrames = 0;
+    x->kernel = runningKernel(x);
+    x->kernel(x, in_mag, in_phase, in_index, out_mag, out_phase, sampleframes);
+}
+
+/**
+ * Band mode kernel
+ * Measures the energy of each band for the next frame and rescales every bin by its band's gain for this one.
+ */
+void bandKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long sampleframes) {
+    t_bands *bands = x->bands;
+    long maxBin = x->fftSize-1;
+    char cartesian = x->cartesian;
+    long bin = CLAMP((long)in_index[0], 0, maxBin);
+    long band = findBand(bands, bin);
+    long start = bands->edge[band];
+    long end = bands->edge[band+1];
+    double ratio = bands->ratio[band];
+    double energy = 0;
+    long seen = bands->seen;
+    
+    for (long k = 0; k < sampleframes; k++) {
+        bin = CLAMP((long)in_index[k], 0, maxBin);
+        seen = MAX(seen, bin + 1);
+        if (bin < start || bin >= end) {
+            bands->energy[band] += energy;
+            energy = 0;
+            band = findBand(bands, bin);
+            start = bands->edge[band];
+            end = bands->edge[band+1];
+            ratio = bands->ratio[band];
+        }
+        double m = in_mag[k];
+        double p = in_phase[k];
+        energy += cartesian ? m*m + p*p : m*m;
+        out_mag[k] = m * ratio;
+        out_phase[k] = cartesian ? p * ratio : p;
+    }
+    bands->energy[band] += energy;
+    bands->seen = seen;
+    shapeVector(x, out_mag, out_phase, sampleframes);
+    
+    if (x->idle) {
+        x->inPeak = vectorPeak(in_mag, sampleframes, x->inPeak);
+        x->outPeak = vectorPeak(out_mag, sampleframes, x->outPeak);
+        if (cartesian) {
+            x->inPeak = vectorPeak(in_phase, sampleframes, x->inPeak);
+            x->outPeak = vectorPeak(out_phase, sampleframes, x->outPeak);
+        }
+    }
+}
+
+/**
+ * Cepstrum mode kernel
+ * Accumulates the DCT of the log magnitudes for the next frame and applies the envelope correction for this one. Both need cos(q*theta)
+ * for every coefficient q, which the Chebyshev recurrence gives without any tables, so the cost per bin is proportional to the number
+ * of coefficients.
+ */
+void cepstrumKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long sampleframes) {
+    t_cepstrum *cep = x->cepstrum;
+    int count = cep->count;
+    long maxBin = x->fftSize-1;
+    char cartesian = x->cartesian;
+    double step = M_PI / MAX(cep->bins, 1);
+    double *sum = cep->sum;
+    double *diff = cep->diff;
+    
+    for (long k = 0; k < sampleframes; k++) {
+        long bin = CLAMP((long)in_index[k], 0, maxBin);
+        cep->seen = MAX(cep->seen, bin + 1);
+        double m = in_mag[k];
+        double p = in_phase[k];
+        double level = cartesian ? sqrt(m*m + p*p) : fabs(m);
+        double logLevel = log(MAX(level, IDLE_FLOOR));
+        
+        // cos(q*theta) for q = 0, 1, 2... from cos((q+1)*theta) = 2*cos(theta)*cos(q*theta) - cos((q-1)*theta)
+        double c = cos((bin + 0.5) * step);
+        double twoC = 2 * c;
+        double prev = 1;
+        double curr = c;
+        double correction = diff[0];
+        sum[0] += logLevel;
+        for (int q = 1; q < count; q++) {
+            sum[q] += logLevel * curr;
+            correction += diff[q] * curr;
+            double next = twoC * curr - prev;
+            prev = curr;
+            curr = next;
+        }
+        double gain = exp(CLAMP(correction, -MAX_ENVELOPE_GAIN, MAX_ENVELOPE_GAIN));
+        out_mag[k] = m * gain;
+        out_phase[k] = cartesian ? p * gain : p;
+    }
+    shapeVector(x, out_mag, out_phase, sampleframes);
+    
+    if (x->idle) {
+        x->inPeak = vectorPeak(in_mag, sampleframes, x->inPeak);
+        x->outPeak = vectorPeak(out_mag, sampleframes, x->outPeak);
+        if (cartesian) {
+            x->inPeak = vectorPeak(in_phase, sampleframes, x->inPeak);
+            x->outPeak = vectorPeak(out_phase, sampleframes, x->outPeak);
+        }
+    }
+}
+
+/**
+ * Snapshot morphing kernel
+ */
+void morphKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long sampleframes) {
+    blendSnapshots(x, in_index, out_mag, out_phase, sampleframes);
+    shapeVector(x, out_mag, out_phase, sampleframes);
+    x->silentFrames = 0; // The blend doesn't depend on the input, so never go idle straight after morphing
+}
+
+/**
+ * Bypass kernel: passes the input straight through. The interpolation state is left as it is.
+ */
+void bypassKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long sampleframes) {
+    memcpy(out_mag, in_mag, sizeof(double) * sampleframes);
+    memcpy(out_phase, in_phase, sizeof(double) * sampleframes);
+    x->silentFrames = 0;
+}
+
+/**
+ * Freeze kernel: holds every bin at its current value without advancing the glides
+ */
+void freezeKernel(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase, long sampleframes) {
+    long maxBin = x->fftSize-1;
+    for (long k = 0; k < sampleframes; k++) {
+        long bin = CLAMP((long)in_index[k], 0, maxBin);
+        out_mag[k] = x->currMag[bin];
+        out_phase[k] = x->currPhase[bin];
+    }
+    if (x->cartesian) {
+        for (long k = 0; k < sampleframes; k++) {
+            x->scratch[k] = x->currAbs[CLAMP((long)in_index[k], 0, maxBin)];
+        }
+        preserveMagnitude(out_mag, out_phase, x->scratch, sampleframes);
+    }
+    shapeVector(x, out_mag, out_phase, sampleframes);
+    x->silentFrames = 0;
+}
+
+/**
+ * Apply the gain and gate stages to a vector that has already been written, for the kernels that don't glide per bin
+ * In cartesian mode the gate compares the magnitude of each real/imaginary pair and the gain scales both components,
+ * otherwise both act on the magnitude alone. Bypass is left untouched.
+ */
+void shapeVector(t_interp *x, double *out_mag, double *out_phase, long n) {
+    double gain = x->gain;
+    double gate = x->gate;
+    if (gain == 1. && gate <= 0)
+        return;
+    char cartesian = x->cartesian;
+    for (long k = 0; k < n; k++) {
+        double level = cartesian ? sqrt(out_mag[k]*out_mag[k] + out_phase[k]*out_phase[k]) : fabs(out_mag[k]);
+        double scale = (level < gate) ? 0 : gain;
+        out_mag[k] *= scale;
+        if (cartesian)
+            out_phase[k] *= scale;
     }
 }
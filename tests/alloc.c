@@ -0,0 +1,248 @@
+// Makes each allocation a message or the DSP setup can make fail in turn (with stub_fail_alloc) and checks the object fails
+// cleanly: it posts an error, leaves the feature off with nothing half allocated, keeps processing, and can allocate it later.
+// Run under AddressSanitizer, so a NULL that is used anyway or a partial allocation that is freed twice stops the test.
+
+#include "../nb.binterpolate~.c"
+
+#define FFT_SIZE 256
+#define VECTOR_SIZE 64
+#define FRAMES 4
+
+static t_interp *newObject(char compact) {
+    t_atom argv[4];
+    atom_setfloat(argv, 0.02);
+    atom_setfloat(argv+1, 0.01);
+    atom_setlong(argv+2, FFT_SIZE);
+    atom_setlong(argv+3, compact);
+    return interp_new(gensym("nb.binterpolate~"), 4, argv);
+}
+
+/**
+ * Run a few frames through the object
+ */
+static void run(t_interp *x) {
+    double mag[VECTOR_SIZE], phase[VECTOR_SIZE], index[VECTOR_SIZE], out[2][VECTOR_SIZE];
+    double *ins[3] = {mag, phase, index};
+    double *outs[2] = {out[0], out[1]};
+    for (int f = 0; f < FRAMES; f++) {
+        for (long start = 0; start < FFT_SIZE; start += VECTOR_SIZE) {
+            for (long i = 0; i < VECTOR_SIZE; i++) {
+                mag[i] = 1 + sin(0.1 * (start + i) + f);
+                phase[i] = 0.5;
+                index[i] = start + i;
+            }
+            interp_perform64(x, NULL, ins, 3, outs, 2, VECTOR_SIZE, 0, NULL);
+        }
+    }
+}
+
+/**
+ * Check that exactly one error was posted since errors was taken, and report the allocation that was made to fail if not
+ */
+static int posted(const char *name, long which, long errors) {
+    if (stub_errors != errors + 1) {
+        printf("alloc: %s: failing allocation %ld posted %ld errors\n", name, which, stub_errors - errors);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * The scratch space allocated when DSP starts. The object stays out of the DSP chain until it can be allocated.
+ */
+static int checkScratch(void) {
+    t_interp *x = newObject(0);
+    long errors = stub_errors;
+    stub_fail_alloc = 0;
+    interp_dsp64(x, NULL, NULL, 44100, VECTOR_SIZE, 0);
+    stub_fail_alloc = -1;
+    int failed = !posted("dsp", 0, errors);
+    if (x->scratch || x->scratchSize != 0) {
+        printf("alloc: dsp: scratchSize is %ld without any scratch space\n", x->scratchSize);
+        failed = 1;
+    }
+    interp_dsp64(x, NULL, NULL, 44100, VECTOR_SIZE, 0);
+    if (!x->scratch || x->scratchSize != VECTOR_SIZE) {
+        printf("alloc: dsp: the scratch space wasn't allocated once there was memory\n");
+        failed = 1;
+    }
+    run(x);
+    interp_free(x);
+    return failed;
+}
+
+/**
+ * The five crossfade lanes allocated by the first overlap message
+ */
+static int checkOverlap(void) {
+    int failed = 0;
+    for (long which = 0; which < 5 && !failed; which++) {
+        t_interp *x = newObject(0);
+        interp_dsp64(x, NULL, NULL, 44100, VECTOR_SIZE, 0);
+        long errors = stub_errors;
+        stub_fail_alloc = which;
+        interp_overlap(x, 0.05);
+        stub_fail_alloc = -1;
+        failed = !posted("overlap", which, errors);
+        if (x->fadeMag || x->fadePhase || x->fadeIncMag || x->fadeIncPhase || x->fadeCount || x->overlapSecs != 0 || x->overlapFrames != 0) {
+            printf("alloc: overlap: failing allocation %ld left overlap half set up\n", which);
+            failed = 1;
+        }
+        run(x);
+        interp_overlap(x, 0.05);
+        if (!x->fadeMag || x->overlapFrames == 0) {
+            printf("alloc: overlap: couldn't switch overlap on after failing allocation %ld\n", which);
+            failed = 1;
+        }
+        run(x);
+        interp_free(x);
+    }
+    return failed;
+}
+
+/**
+ * The magnitude lanes allocated by the first cartesian message
+ */
+static int checkCartesian(void) {
+    int failed = 0;
+    for (long which = 0; which < 2 && !failed; which++) {
+        t_interp *x = newObject(0);
+        interp_dsp64(x, NULL, NULL, 44100, VECTOR_SIZE, 0);
+        long errors = stub_errors;
+        stub_fail_alloc = which;
+        interp_cartesian(x, 1);
+        stub_fail_alloc = -1;
+        failed = !posted("cartesian", which, errors);
+        if (x->currAbs || x->incAbs || x->cartesianRequest) {
+            printf("alloc: cartesian: failing allocation %ld left cartesian mode half set up\n", which);
+            failed = 1;
+        }
+        run(x);
+        if (x->cartesian) {
+            printf("alloc: cartesian: the perform method switched cartesian mode on after failing allocation %ld\n", which);
+            failed = 1;
+        }
+        interp_cartesian(x, 1);
+        run(x);
+        if (!x->currAbs || !x->cartesian) {
+            printf("alloc: cartesian: couldn't switch cartesian mode on after failing allocation %ld\n", which);
+            failed = 1;
+        }
+        interp_free(x);
+    }
+    return failed;
+}
+
+/**
+ * The wake-up frames, wheel links and awake bits allocated by the first rest message
+ */
+static int checkRest(void) {
+    int failed = 0;
+    for (long which = 0; which < 3 && !failed; which++) {
+        t_interp *x = newObject(0);
+        interp_dsp64(x, NULL, NULL, 44100, VECTOR_SIZE, 0);
+        long errors = stub_errors;
+        stub_fail_alloc = which;
+        interp_rest(x, 0.05);
+        stub_fail_alloc = -1;
+        failed = !posted("rest", which, errors);
+        if (x->restAwake || x->wakeFrame || x->restNext || x->restSecs != 0 || x->restFrames != 0) {
+            printf("alloc: rest: failing allocation %ld left rests half set up\n", which);
+            failed = 1;
+        }
+        run(x);
+        interp_rest(x, 0.05);
+        if (!x->restAwake || x->restFrames == 0) {
+            printf("alloc: rest: couldn't switch rests on after failing allocation %ld\n", which);
+            failed = 1;
+        }
+        run(x);
+        interp_free(x);
+    }
+    return failed;
+}
+
+/**
+ * The snapshot memory allocated by the first snap message, in both layouts
+ */
+static int checkSnap(void) {
+    int failed = 0;
+    for (long which = 0; which < 4 && !failed; which++) {
+        char compact = which >= 2;
+        t_interp *x = newObject(compact);
+        interp_dsp64(x, NULL, NULL, 44100, VECTOR_SIZE, 0);
+        long errors = stub_errors;
+        stub_fail_alloc = which % 2;
+        interp_snap(x, 0);
+        stub_fail_alloc = -1;
+        failed = !posted("snap", which, errors);
+        if (x->snapMag || x->snapPhase || x->snapMagHalf || x->snapPhaseHalf || x->snapRequest != -1) {
+            printf("alloc: snap: failing allocation %ld left the snapshots half set up\n", which);
+            failed = 1;
+        }
+        run(x);
+        interp_snap(x, 0);
+        run(x);
+        if (!x->snapFilled[0]) {
+            printf("alloc: snap: couldn't take a snapshot after failing allocation %ld\n", which);
+            failed = 1;
+        }
+        interp_free(x);
+    }
+    return failed;
+}
+
+/**
+ * The file struct and frame cache allocated by the read message
+ */
+static int checkFrameFile(void) {
+    const char *path = "build/alloc.nbsf";
+    t_framefile_header header = {FRAME_FILE_MAGIC, FRAME_FILE_VERSION, FFT_SIZE, FFT_SIZE, 44100, 0, 2};
+    static float frames[2][2][FFT_SIZE];
+    FILE *fp = fopen(path, "wb");
+    if (!fp || fwrite(&header, sizeof(header), 1, fp) != 1 || fwrite(frames, sizeof(frames), 1, fp) != 1) {
+        printf("alloc: read: couldn't write %s\n", path);
+        return 1;
+    }
+    fclose(fp);
+    
+    int failed = 0;
+    for (long which = 0; which < 2 && !failed; which++) {
+        t_interp *x = newObject(0);
+        interp_dsp64(x, NULL, NULL, 44100, VECTOR_SIZE, 0);
+        long errors = stub_errors;
+        stub_fail_alloc = which;
+        interp_doread(x, gensym(path), 0, NULL);
+        stub_fail_alloc = -1;
+        failed = !posted("read", which, errors);
+        if (atomic_load(&x->frameFile)) {
+            printf("alloc: read: failing allocation %ld still loaded the file\n", which);
+            failed = 1;
+        }
+        interp_play(x, 1);
+        run(x);
+        interp_doread(x, gensym(path), 0, NULL);
+        if (!atomic_load(&x->frameFile)) {
+            printf("alloc: read: couldn't read the file after failing allocation %ld\n", which);
+            failed = 1;
+        }
+        run(x);
+        interp_free(x);
+    }
+    remove(path);
+    return failed;
+}
+
+int main(void) {
+    ext_main(NULL);
+    int failed = 0;
+    failed |= checkScratch();
+    failed |= checkOverlap();
+    failed |= checkCartesian();
+    failed |= checkRest();
+    failed |= checkSnap();
+    failed |= checkFrameFile();
+    if (!failed)
+        printf("alloc: ok\n");
+    return failed;
+}
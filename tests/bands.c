@@ -0,0 +1,70 @@
+// Checks switching band mode on part way through, inside a (simulated) pfft~ that passes half the spectrum:
+// - The output doesn't dip: the first frame is passed through while its levels are measured, and the glides start from those
+//   levels, so with a steady input every frame comes out as it went in.
+// - Variants lay their bands out over the same bins as the object itself from the first frame.
+
+#include "../nb.binterpolate~.c"
+
+#define FFT_SIZE 1024
+#define HOP_SIZE 256
+#define BINS (FFT_SIZE / 2)
+#define VECTOR_SIZE 64
+#define VARIANTS 2
+#define FRAMES 40
+#define BANDS_FRAME 10
+#define TOLERANCE 1e-12
+
+int main(void) {
+    ext_main(NULL);
+    t_pfftpub pfft = {FFT_SIZE, HOP_SIZE, 0};
+    t_atom argv[5];
+    atom_setfloat(argv, 0.1);
+    atom_setfloat(argv+1, 0.05);
+    atom_setlong(argv+2, 0);
+    atom_setlong(argv+3, 0);
+    atom_setlong(argv+4, VARIANTS);
+    gensym("__pfft~__")->s_thing = &pfft;
+    t_interp *x = interp_new(gensym("nb.binterpolate~"), 5, argv);
+    gensym("__pfft~__")->s_thing = NULL;
+    interp_dsp64(x, NULL, NULL, 44100, VECTOR_SIZE, 0);
+    double mag[BINS], phase[BINS], index[BINS];
+    static double out[2*VARIANTS][BINS];
+    int failed = 0;
+
+    for (long i = 0; i < BINS; i++) {
+        mag[i] = 1 + sin(0.03 * i);
+        phase[i] = cos(0.2 * i);
+        index[i] = i;
+    }
+    for (int f = 0; f < FRAMES && !failed; f++) {
+        if (f == BANDS_FRAME)
+            interp_bands(x, 16);
+        for (long start = 0; start < BINS; start += VECTOR_SIZE) {
+            double *ins[3] = {mag + start, phase + start, index + start};
+            double *outs[2*VARIANTS];
+            for (int o = 0; o < 2*VARIANTS; o++)
+                outs[o] = out[o] + start;
+            interp_perform64(x, NULL, ins, 3, outs, 2*VARIANTS, VECTOR_SIZE, 0, NULL);
+        }
+        if (f < BANDS_FRAME)
+            continue;
+        for (int v = 0; v < VARIANTS && !failed; v++) {
+            t_interp *s = v ? x->variants[v-1] : x;
+            if (s->bands->bins != BINS) {
+                printf("bands: variant %d laid its bands out over %ld bins in frame %d, not %d\n", v, s->bands->bins, f, BINS);
+                failed = 1;
+            }
+            for (long i = 0; i < BINS && !failed; i++) {
+                if (fabs(out[2*v][i] - mag[i]) > TOLERANCE * mag[i] || out[2*v+1][i] != phase[i]) {
+                    printf("bands: variant %d output %g instead of %g in bin %ld of frame %d\n", v, out[2*v][i], mag[i], i, f);
+                    failed = 1;
+                }
+            }
+        }
+    }
+    interp_free(x);
+
+    if (!failed)
+        printf("bands: ok\n");
+    return failed;
+}
@@ -0,0 +1,241 @@
+// Quality-versus-throughput benchmark for the modes that trade accuracy for speed, run with make bench (not part of make test).
+// Feeds each test signal through one instance of every mode in lockstep and prints a table of the time per bin and the speed
+// relative to real time. Modes meant to follow the per-bin glides (compact, cartesian) are also measured against the per-bin
+// reference: the SNR of their output magnitudes, the largest single-bin error relative to the reference's peak, and the change
+// in SNR between the first and last minute (negative if the error grows). Bands and cepstrum follow the spectral envelope
+// instead by design, so they only get throughput. Then the fast reciprocal square root cartesian mode uses is checked on its own.
+//
+//   bench [fft size [length [variance [results.json]]]]
+
+#include "../nb.binterpolate~.c"
+#include "signals.h"
+
+#define SECONDS 600             // Length of audio simulated for each signal
+#define VECTOR_SIZE 256
+#define SEED 1                  // Every instance draws the same glide lengths
+#define RSQRT_VALUES 1000000    // Values fastRsqrt is checked on, spread evenly in log over MIN_CARTESIAN_POWER to 1e12
+
+// The modes. The first is the reference the measured ones are compared with.
+static const struct {
+    const char* name;
+    char        compact;
+    char        cartesian;
+    int         bands;
+    int         cepstrum;
+    char        measured;
+} modes[] = {
+    { "reference",      0,  0,  0,      0,      0 },
+    { "compact",        1,  0,  0,      0,      1 },
+    { "cartesian",      0,  1,  0,      0,      1 },
+    { "bands 32",       0,  0,  32,     0,      0 },
+    { "bands 128",      0,  0,  128,    0,      0 },
+    { "cepstrum 20",    0,  0,  0,      20,     0 },
+    { "cepstrum 60",    0,  0,  0,      60,     0 },
+};
+#define NUM_MODES (int)(sizeof(modes) / sizeof(modes[0]))
+
+// Totals for one mode on one signal. Errors are measured against the reference mode.
+typedef struct _result {
+    double      seconds;                // Time spent in the perform method
+    double      signal;                 // Energy of the reference output
+    double      error;                  // Energy of the difference from the reference output
+    double      firstSignal;            // The same over the first and last minute, for the drift
+    double      firstError;
+    double      lastSignal;
+    double      lastError;
+    double      maxError;               // Largest difference in any one bin
+    double      peak;                   // Largest magnitude of the reference output
+} t_result;
+
+/**
+ * @return the signal to noise ratio in dB, or INFINITY if there was no error
+ */
+static double snr(double signal, double error) {
+    return (error > 0) ? 10. * log10(signal / error) : INFINITY;
+}
+
+/**
+ * Create an instance for one mode, with its mode switched on and DSP started
+ */
+static t_interp *newInstance(int mode, long fftSize, double length, double variance) {
+    t_atom argv[4];
+    atom_setfloat(argv, length);
+    atom_setfloat(argv+1, variance);
+    atom_setlong(argv+2, fftSize);
+    atom_setlong(argv+3, modes[mode].compact);
+    t_interp *x = interp_new(gensym("nb.binterpolate~"), 4, argv);
+    if (!x)
+        return NULL;
+    seedRandom(x, SEED);
+    memset(x->updateTarget, 1, x->fftSize);
+    if (modes[mode].cartesian)
+        interp_cartesian(x, 1);
+    if (modes[mode].bands)
+        interp_bands(x, modes[mode].bands);
+    if (modes[mode].cepstrum)
+        interp_cepstrum(x, modes[mode].cepstrum);
+    interp_dsp64(x, NULL, NULL, x->sampleRate, MIN(VECTOR_SIZE, fftSize), 0);
+    return x;
+}
+
+/**
+ * Add the difference between one frame of a mode's output magnitudes and the reference's to its totals
+ * @param first 1 if the frame is in the first minute
+ * @param last 1 if the frame is in the last minute
+ */
+static void compareFrame(t_result *r, const double *refMag, const double *mag, long bins, char first, char last) {
+    double signal = 0;
+    double error = 0;
+    for (long i = 0; i < bins; i++) {
+        double d = refMag[i] - mag[i];
+        signal += refMag[i]*refMag[i];
+        error += d*d;
+        r->maxError = MAX(r->maxError, fabs(d));
+        r->peak = MAX(r->peak, fabs(refMag[i]));
+    }
+    r->signal += signal;
+    r->error += error;
+    if (first) {
+        r->firstSignal += signal;
+        r->firstError += error;
+    }
+    if (last) {
+        r->lastSignal += signal;
+        r->lastError += error;
+    }
+}
+
+/**
+ * Print the largest relative error of fastRsqrt over the range of powers cartesian mode rescales, and its time per call
+ * against 1/sqrt
+ */
+static void benchRsqrt(FILE *json) {
+    static double values[RSQRT_VALUES], out[RSQRT_VALUES];
+    double low = log(MIN_CARTESIAN_POWER);
+    double high = log(1e12);
+    for (long i = 0; i < RSQRT_VALUES; i++)
+        values[i] = exp(low + (high - low) * i / (RSQRT_VALUES - 1));
+
+    double start = monotonicTime();
+    for (long i = 0; i < RSQRT_VALUES; i++)
+        out[i] = fastRsqrt(values[i]);
+    double fastSeconds = monotonicTime() - start;
+    double worst = 0;
+    for (long i = 0; i < RSQRT_VALUES; i++)
+        worst = MAX(worst, fabs(out[i] * sqrt(values[i]) - 1));
+    start = monotonicTime();
+    for (long i = 0; i < RSQRT_VALUES; i++)
+        out[i] = 1. / sqrt(values[i]);
+    double exactSeconds = monotonicTime() - start;
+
+    double fastNs = fastSeconds * 1e9 / RSQRT_VALUES;
+    double exactNs = exactSeconds * 1e9 / RSQRT_VALUES;
+    printf("fastRsqrt: max relative error %.2e, %.2f ns per value (1/sqrt %.2f ns)\n", worst, fastNs, exactNs);
+    if (json)
+        fprintf(json, "  \"fastRsqrt\": {\"maxError\": %.6g, \"ns\": %.4f, \"sqrtNs\": %.4f},\n", worst, fastNs, exactNs);
+}
+
+int main(int argc, char **argv) {
+    ext_main(NULL);
+    long bins = (argc > 1) ? atol(argv[1]) : 1024;
+    double length = (argc > 2) ? atof(argv[2]) : DEFAULT_LENGTH;
+    double variance = (argc > 3) ? atof(argv[3]) : DEFAULT_VARIANCE;
+    const char *path = (argc > 4) ? argv[4] : NULL;
+    int sampleRate = (int)sys_getsr();
+    long frames = MAX(1, (long)((double)SECONDS * sampleRate / bins));
+    long minute = MAX(1, (long)(60. * sampleRate / bins));
+    long vector = MIN(VECTOR_SIZE, bins);
+    static t_result results[NUM_SIGNALS][NUM_MODES];
+    t_interp *instances[NUM_MODES] = {NULL};
+    double *buffers = (double *)calloc(bins * (3 + 2*NUM_MODES), sizeof(double));
+    if (!buffers) {
+        printf("bench: not enough memory\n");
+        return 1;
+    }
+
+    for (int signal = 0; signal < NUM_SIGNALS; signal++) {
+        double *inMag = buffers;
+        double *inPhase = inMag + bins;
+        double *index = inPhase + bins;
+        for (long i = 0; i < bins; i++)
+            index[i] = i;
+        for (int m = 0; m < NUM_MODES; m++) {
+            instances[m] = newInstance(m, bins, length, variance);
+            if (!instances[m] || instances[m]->fftSize != bins) {
+                printf("bench: couldn't create an instance with an FFT size of %ld\n", bins);
+                return 1;
+            }
+        }
+
+        uint64_t rng = SEED;
+        for (long frame = 0; frame < frames; frame++) {
+            testSignal(signal, frame, bins, sampleRate, &rng, inMag, inPhase);
+            for (int m = 0; m < NUM_MODES; m++) {
+                double *outMag = buffers + bins * (3 + 2*m);
+                double *outPhase = outMag + bins;
+                double start = monotonicTime();
+                for (long v = 0; v < bins; v += vector) {
+                    long n = MIN(vector, bins - v);
+                    double *ins[3] = {inMag + v, inPhase + v, index + v};
+                    double *outs[2] = {outMag + v, outPhase + v};
+                    interp_perform64(instances[m], NULL, ins, 3, outs, 2, n, 0, NULL);
+                }
+                results[signal][m].seconds += monotonicTime() - start;
+                if (modes[m].measured)
+                    compareFrame(&results[signal][m], buffers + 3*bins, outMag, bins, frame < minute, frame >= frames - minute);
+            }
+        }
+        for (int m = 0; m < NUM_MODES; m++)
+            interp_free(instances[m]);
+    }
+    free(buffers);
+
+    FILE *json = path ? fopen(path, "w") : NULL;
+    if (path && !json)
+        printf("bench: can't open %s for writing\n", path);
+    if (json)
+        fprintf(json, "{\n  \"fftSize\": %ld,\n  \"sampleRate\": %d,\n  \"seconds\": %d,\n", bins, sampleRate, SECONDS);
+    benchRsqrt(json);
+    if (json)
+        fprintf(json, "  \"results\": [");
+    printf("bench: %ld bins, %d seconds of each signal\n", bins, SECONDS);
+    printf("%-12s %-9s %9s %9s %9s %10s %9s\n", "mode", "signal", "ns/bin", "realtime", "SNR dB", "max error", "drift dB");
+    for (int signal = 0; signal < NUM_SIGNALS; signal++) {
+        for (int m = 0; m < NUM_MODES; m++) {
+            const t_result *r = &results[signal][m];
+            double nsPerBin = r->seconds * 1e9 / ((double)frames * bins);
+            double realtime = SECONDS / MAX(r->seconds, 1e-9);
+            printf("%-12s %-9s %9.2f %8.0fx", modes[m].name, signalNames[signal], nsPerBin, realtime);
+            if (json)
+                fprintf(json, "%s\n    {\"mode\": \"%s\", \"signal\": \"%s\", \"nsPerBin\": %.4f, \"realtime\": %.2f",
+                        (signal || m) ? "," : "", modes[m].name, signalNames[signal], nsPerBin, realtime);
+            if (!modes[m].measured) {
+                printf(" %9s %10s %9s\n", "-", "-", "-");
+                if (json)
+                    fprintf(json, "}");
+                continue;
+            }
+            double ratio = snr(r->signal, r->error);
+            double maxError = (r->peak > 0) ? r->maxError / r->peak : 0;
+            double drift = snr(r->lastSignal, r->lastError) - snr(r->firstSignal, r->firstError);
+            if (isnan(drift))
+                drift = 0; // Both minutes exact
+            printf(" %9.1f %10.2e %9.2f\n", ratio, maxError, drift);
+            if (json) {
+                if (isinf(ratio))
+                    fprintf(json, ", \"snrDb\": null");
+                else
+                    fprintf(json, ", \"snrDb\": %.3f", ratio);
+                fprintf(json, ", \"maxError\": %.6g, \"driftDb\": %.3f}", maxError, isinf(drift) ? 0. : drift);
+            }
+        }
+    }
+    if (json) {
+        fprintf(json, "\n  ]\n}\n");
+        if (fclose(json) != 0) {
+            printf("bench: couldn't write %s\n", path);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+// Checks that freeze holds the output in every mode it can be switched on in:
+// - Per-bin glides, morphing between snapshots, bands and cepstrum. Once freeze has been picked up on a frame boundary, every
+//   frame is identical to the last one before it.
+// - A morph sent while frozen doesn't change the output until freeze is switched off, and morphing carries on afterwards.
+
+#include "../nb.binterpolate~.c"
+
+#define FFT_SIZE 512
+#define VECTOR_SIZE 64
+#define FROZEN_FRAMES 20
+
+enum { MODE_GLIDE, MODE_MORPH, MODE_BANDS, MODE_CEPSTRUM, NUM_MODES };
+static const char *modeNames[NUM_MODES] = {"glide", "morph", "bands", "cepstrum"};
+
+/**
+ * Run one frame through the object. The input is steady, so bands and cepstrum output the same frame while their levels hold.
+ */
+static void runFrame(t_interp *x, int frame, double out[2][FFT_SIZE]) {
+    double mag[VECTOR_SIZE], phase[VECTOR_SIZE], index[VECTOR_SIZE];
+    double *ins[3] = {mag, phase, index};
+    for (long start = 0; start < FFT_SIZE; start += VECTOR_SIZE) {
+        for (long i = 0; i < VECTOR_SIZE; i++) {
+            double swap = (frame < 10) ? 1 : 3;
+            mag[i] = 1 + fabs(sin(0.05 * swap * (start + i)));
+            phase[i] = cos(0.3 * (start + i));
+            index[i] = start + i;
+        }
+        double *outs[2] = {out[0] + start, out[1] + start};
+        interp_perform64(x, NULL, ins, 3, outs, 2, VECTOR_SIZE, 0, NULL);
+    }
+}
+
+static void morph(t_interp *x, double w0, double w1) {
+    t_atom weights[2];
+    atom_setfloat(weights, w0);
+    atom_setfloat(weights+1, w1);
+    interp_morph(x, NULL, 2, weights);
+}
+
+static int checkFreeze(int mode) {
+    t_atom argv[3];
+    atom_setfloat(argv, 1);
+    atom_setfloat(argv+1, 0.2);
+    atom_setlong(argv+2, FFT_SIZE);
+    t_interp *x = interp_new(gensym("nb.binterpolate~"), 3, argv);
+    seedRandom(x, 1);
+    interp_dsp64(x, NULL, NULL, 44100, VECTOR_SIZE, 0);
+    static double before[2][FFT_SIZE], out[2][FFT_SIZE];
+    int failed = 0;
+    int f = 0;
+
+    interp_snap(x, 0);
+    for (; f < 12; f++) {
+        if (f == 11)
+            interp_snap(x, 1);
+        runFrame(x, f, out);
+    }
+    if (mode == MODE_MORPH) {
+        morph(x, 1, 0);
+        runFrame(x, f++, out);
+        morph(x, 0, 1);     // Glides for about a second, so it is mid-morph when freeze comes
+    } else if (mode == MODE_BANDS) {
+        interp_bands(x, 16);
+    } else if (mode == MODE_CEPSTRUM) {
+        interp_cepstrum(x, 12);
+    }
+    for (int end = f + 10; f < end; f++)
+        runFrame(x, f, before);
+
+    interp_freeze(x, 1);
+    for (int end = f + FROZEN_FRAMES; f < end && !failed; f++) {
+        if (mode == MODE_MORPH && f == end - FROZEN_FRAMES/2)
+            morph(x, 1, 1);
+        runFrame(x, f, out);
+        if (memcmp(out, before, sizeof(out)) != 0) {
+            long bin = 0;
+            while (out[0][bin] == before[0][bin] && out[1][bin] == before[1][bin])
+                bin++;
+            printf("freeze: %s: frame %d changed while frozen (bin %ld went from %g to %g)\n", modeNames[mode], f, bin, before[0][bin], out[0][bin]);
+            failed = 1;
+        }
+    }
+
+    interp_freeze(x, 0);
+    runFrame(x, f++, out);
+    runFrame(x, f++, out);
+    if (mode == MODE_MORPH && !failed && memcmp(out, before, sizeof(out)) == 0) {
+        printf("freeze: morph: the morph sent while frozen didn't start once freeze was switched off\n");
+        failed = 1;
+    }
+    interp_free(x);
+    return failed;
+}
+
+int main(void) {
+    ext_main(NULL);
+    int failed = 0;
+    for (int mode = 0; mode < NUM_MODES; mode++)
+        failed |= checkFreeze(mode);
+    if (!failed)
+        printf("freeze: ok\n");
+    return failed;
+}
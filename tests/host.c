@@ -0,0 +1,168 @@
+// Standalone real-time host, run with make host (not part of make test). A clock-paced null driver: a thread wakes up at every
+// audio buffer deadline, as a sound card's interrupt would, and runs the frames a (simulated) pfft~ would process in that buffer,
+// one call per hop with half the FFT size in bins. Nothing is played, so the timing is the object's own plus the scheduler's.
+// Reports the callback time against the buffer period and counts xruns: callbacks that finished after the next buffer was due.
+// The thread asks for SCHED_FIFO, which needs permission (root, or an rtprio limit on Linux); without it the figures include
+// whatever else the machine is doing.
+// There is no JACK or ALSA backend, so the host doesn't depend on either being installed.
+//
+//   host [seconds [fft size [overlap [buffer size [variants]]]]]
+
+#include "../nb.binterpolate~.c"
+#include "signals.h"
+#include <pthread.h>
+#include <sched.h>
+
+#define SAMPLE_RATE 44100
+#define INPUT_FRAMES 64         // Frames of noise generated up front and cycled through, so generating them isn't timed
+
+typedef struct _host {
+    t_interp*   x;
+    long        fftSize;
+    long        hop;
+    long        bins;
+    long        buffer;                 // Samples per callback
+    long        callbacks;
+    double*     input;                  // INPUT_FRAMES frames of magnitudes then phases
+    double*     index;
+    double**    outs;
+    double*     seconds;                // Time each callback took
+    double      maxLate;                // Latest wake-up after a deadline
+    long        xruns;
+    long        overruns;               // Xruns where the callback alone took longer than the period
+    char        realtime;               // 1 if the thread got SCHED_FIFO
+} t_host;
+
+static double toSeconds(const struct timespec *ts) {
+    return ts->tv_sec + 1e-9 * ts->tv_nsec;
+}
+
+static void addSeconds(struct timespec *ts, double seconds) {
+    long ns = ts->tv_nsec + (long)(seconds * 1e9);
+    ts->tv_sec += ns / 1000000000L;
+    ts->tv_nsec = ns % 1000000000L;
+}
+
+/**
+ * Driver thread: sleep until each buffer is due, then run the frames whose hops start in it
+ */
+static void *driver(void *arg) {
+    t_host *h = (t_host *)arg;
+    struct sched_param param = {sched_get_priority_max(SCHED_FIFO) - 1};
+    h->realtime = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+
+    double period = (double)h->buffer / SAMPLE_RATE;
+    long nextHop = 0;
+    long frame = 0;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    addSeconds(&deadline, period);
+    for (long c = 0; c < h->callbacks; c++) {
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) != 0)
+            ;
+        struct timespec wake, done;
+        clock_gettime(CLOCK_MONOTONIC, &wake);
+        h->maxLate = MAX(h->maxLate, toSeconds(&wake) - toSeconds(&deadline));
+
+        long end = (c + 1) * h->buffer;
+        for (; nextHop < end; nextHop += h->hop, frame++) {
+            double *mag = h->input + (frame % INPUT_FRAMES) * 2 * h->bins;
+            double *ins[3] = {mag, mag + h->bins, h->index};
+            interp_perform64(h->x, NULL, ins, 3, h->outs, 2 * (h->x->variantCount + 1), h->bins, 0, NULL);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &done);
+        h->seconds[c] = toSeconds(&done) - toSeconds(&wake);
+        addSeconds(&deadline, period);
+        if (toSeconds(&done) > toSeconds(&deadline)) {
+            // The next buffer wasn't ready in time. Like a driver, skip the deadlines that have passed rather than bunching up.
+            h->xruns++;
+            if (h->seconds[c] > period)
+                h->overruns++;
+            while (toSeconds(&deadline) < toSeconds(&done))
+                addSeconds(&deadline, period);
+        }
+    }
+    return NULL;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double d = *(const double *)a - *(const double *)b;
+    return (d > 0) - (d < 0);
+}
+
+int main(int argc, char **argv) {
+    ext_main(NULL);
+    double seconds = (argc > 1) ? atof(argv[1]) : 60;
+    long fftSize = (argc > 2) ? atol(argv[2]) : 1024;
+    long overlap = (argc > 3) ? atol(argv[3]) : 4;
+    long buffer = (argc > 4) ? atol(argv[4]) : 256;
+    long variants = (argc > 5) ? atol(argv[5]) : 1;
+    if (fftSize < 2 || overlap < 1 || buffer < 1 || variants < 1 || variants > MAX_VARIANTS) {
+        printf("host: usage: host [seconds [fft size [overlap [buffer size [variants]]]]]\n");
+        return 1;
+    }
+
+    t_host h = {0};
+    h.fftSize = fftSize;
+    h.hop = MAX(1, fftSize / overlap);
+    h.bins = fftSize / 2;
+    h.buffer = buffer;
+    h.callbacks = MAX(1, (long)(seconds * SAMPLE_RATE / buffer));
+    t_pfftpub pfft = {fftSize, h.hop, 0};
+    t_atom args[5];
+    atom_setfloat(args, DEFAULT_LENGTH);
+    atom_setfloat(args+1, DEFAULT_VARIANCE);
+    atom_setlong(args+2, 0);
+    atom_setlong(args+3, 0);
+    atom_setlong(args+4, variants);
+    gensym("__pfft~__")->s_thing = &pfft;
+    h.x = interp_new(gensym("nb.binterpolate~"), 5, args);
+    gensym("__pfft~__")->s_thing = NULL;
+    h.input = (double *)calloc(INPUT_FRAMES * 2 * h.bins, sizeof(double));
+    h.index = (double *)calloc(h.bins, sizeof(double));
+    h.outs = (double **)calloc(2 * variants, sizeof(double *));
+    h.seconds = (double *)calloc(h.callbacks, sizeof(double));
+    if (!h.x || !h.input || !h.index || !h.outs || !h.seconds) {
+        printf("host: not enough memory\n");
+        return 1;
+    }
+    for (long o = 0; o < 2 * variants; o++) {
+        h.outs[o] = (double *)calloc(h.bins, sizeof(double));
+        if (!h.outs[o]) {
+            printf("host: not enough memory\n");
+            return 1;
+        }
+    }
+    for (long i = 0; i < h.bins; i++)
+        h.index[i] = i;
+    uint64_t rng = 1;
+    for (long f = 0; f < INPUT_FRAMES; f++) {
+        double *mag = h.input + f * 2 * h.bins;
+        testSignal(SIGNAL_NOISE, f, h.bins, SAMPLE_RATE, &rng, mag, mag + h.bins);
+    }
+    interp_dsp64(h.x, NULL, NULL, SAMPLE_RATE, h.bins, 0);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, driver, &h) != 0) {
+        printf("host: couldn't start the driver thread\n");
+        return 1;
+    }
+    pthread_join(thread, NULL);
+    interp_free(h.x);
+
+    double period = (double)buffer / SAMPLE_RATE;
+    double mean = 0;
+    for (long c = 0; c < h.callbacks; c++)
+        mean += h.seconds[c] / h.callbacks;
+    qsort(h.seconds, h.callbacks, sizeof(double), compareDoubles);
+    double p99 = h.seconds[(long)(0.99 * (h.callbacks - 1))];
+    double worst = h.seconds[h.callbacks - 1];
+    printf("host: %ld-point FFT, hop %ld, %ld variant%s, %ld-sample buffers (%.2f ms) at %d Hz, %s\n",
+           fftSize, h.hop, variants, (variants > 1) ? "s" : "", buffer, 1e3 * period, SAMPLE_RATE, h.realtime ? "SCHED_FIFO" : "normal priority (no permission for SCHED_FIFO)");
+    printf("host: %ld callbacks, %ld xruns (%ld where the callback alone took longer than the period)\n", h.callbacks, h.xruns, h.overruns);
+    printf("host: callback time mean %.1f us (%.1f%%), p99 %.1f us (%.1f%%), max %.1f us (%.1f%%) of the buffer period\n",
+           1e6 * mean, 100 * mean / period, 1e6 * p99, 100 * p99 / period, 1e6 * worst, 100 * worst / period);
+    printf("host: latest wake-up %.1f us after the deadline\n", 1e6 * h.maxLate);
+    return h.xruns > 0;
+}
@@ -0,0 +1,77 @@
+// Checks idle detection:
+// - Switching idle on just after the input goes quiet doesn't cut off the glides that are still dying away. The object only
+//   sleeps once its output has settled below IDLE_FLOOR, however long the input was silent before idle was switched on.
+// - It does go to sleep once everything has settled, and wakes up when the input comes back.
+
+#include "../nb.binterpolate~.c"
+
+#define FFT_SIZE 512
+#define VECTOR_SIZE 64
+#define LOUD_FRAMES 200
+#define QUIET_FRAMES 200
+
+/**
+ * Run one frame through the object
+ * @return the largest output magnitude of the frame
+ */
+static double runFrame(t_interp *x, double level, int frame) {
+    double mag[VECTOR_SIZE], phase[VECTOR_SIZE], index[VECTOR_SIZE], out[2][VECTOR_SIZE];
+    double *ins[3] = {mag, phase, index};
+    double *outs[2] = {out[0], out[1]};
+    double peak = 0;
+    for (long start = 0; start < FFT_SIZE; start += VECTOR_SIZE) {
+        for (long i = 0; i < VECTOR_SIZE; i++) {
+            mag[i] = level * (1 + sin(0.1 * (start + i) + frame));
+            phase[i] = 0;
+            index[i] = start + i;
+        }
+        interp_perform64(x, NULL, ins, 3, outs, 2, VECTOR_SIZE, 0, NULL);
+        peak = vectorPeak(out[0], VECTOR_SIZE, peak);
+    }
+    return peak;
+}
+
+int main(void) {
+    ext_main(NULL);
+    t_atom argv[3];
+    atom_setfloat(argv, 0.1);
+    atom_setfloat(argv+1, 0.05);
+    atom_setlong(argv+2, FFT_SIZE);
+    t_interp *x = interp_new(gensym("nb.binterpolate~"), 3, argv);
+    seedRandom(x, 1);
+    interp_dsp64(x, NULL, NULL, 44100, VECTOR_SIZE, 0);
+    int failed = 0;
+
+    // Loud input with idle off, then silence, with idle switched on a frame into it while the glides are still near their peaks
+    for (int f = 0; f < LOUD_FRAMES; f++)
+        runFrame(x, 4, f);
+    double last = runFrame(x, 0, LOUD_FRAMES);
+    interp_idle(x, 1);
+    int slept = -1;
+    for (int f = 1; f < QUIET_FRAMES && slept < 0; f++) {
+        double peak = runFrame(x, 0, LOUD_FRAMES + f);
+        if (x->sleeping) {
+            slept = f;
+            if (last >= IDLE_FLOOR) {
+                printf("idle: went to sleep %d frames after idle was switched on with the output still at %g\n", f, last);
+                failed = 1;
+            }
+        }
+        last = peak;
+    }
+    if (slept < 0) {
+        printf("idle: never went to sleep after %d silent frames\n", QUIET_FRAMES);
+        failed = 1;
+    }
+
+    // The first loud vector wakes it up again
+    if (runFrame(x, 4, 0) == 0 || x->sleeping) {
+        printf("idle: didn't wake up when the input came back\n");
+        failed = 1;
+    }
+    interp_free(x);
+
+    if (!failed)
+        printf("idle: ok\n");
+    return failed;
+}
@@ -0,0 +1,60 @@
+// Just enough of the Max SDK for nb.binterpolate~.c to build and run outside Max, for the tests.
+// The declarations follow the SDK's; the definitions are in stubs.c.
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#define MAX_PATH_CHARS 2048
+#define CLAMP(a,lo,hi) ((a)>(hi)?(hi):((a)<(lo)?(lo):(a)))
+#define MIN(a,b) ((a)<(b)?(a):(b))
+#define MAX(a,b) ((a)>(b)?(a):(b))
+typedef double t_double;
+typedef void *(*method)(void *, ...);
+typedef struct _symbol { const char *s_name; void *s_thing; } t_symbol;
+typedef struct _object { int dummy; } t_object;
+typedef struct _atom { int type; union { long l; double f; t_symbol *s; } w; } t_atom;
+typedef struct _class t_class;
+typedef struct _clock t_clock;
+typedef long t_fourcc;
+enum { A_NOTHING, A_LONG, A_FLOAT, A_SYM, A_GIMME, A_CANT, A_DEFLONG, A_DEFFLOAT, A_DEFSYM };
+enum { ASSIST_INLET=1, ASSIST_OUTLET };
+enum { CLASS_BOX };
+enum { PATH_STYLE_NATIVE };
+enum { PATH_TYPE_ABSOLUTE };
+t_symbol *gensym(const char *);
+void post(const char *, ...);
+void object_post(t_object *, const char *, ...);
+void object_error(t_object *, const char *, ...);
+void object_warn(t_object *, const char *, ...);
+void *sysmem_newptr(long);
+void *sysmem_newptrclear(long);
+void sysmem_freeptr(void *);
+t_class *class_new(const char *, method, method, long, method, short, ...);
+int class_addmethod(t_class *, method, const char *, ...);
+int class_register(int, t_class *);
+void *object_alloc(t_class *);
+int object_free(void *);
+void *object_method(void *, t_symbol *, ...);
+void *outlet_new(void *, const char *);
+long proxy_getinlet(t_object *);
+double atom_getfloat(const t_atom *);
+long atom_getlong(const t_atom *);
+int atom_setlong(t_atom *, long);
+int atom_setfloat(t_atom *, double);
+t_clock *clock_new(void *, method);
+void clock_fdelay(t_clock *, double);
+void clock_unset(t_clock *);
+void defer_low(void *, method, t_symbol *, short, t_atom *);
+void strncpy_zero(char *, const char *, long);
+short locatefile_extended(char *, short *, t_fourcc *, const t_fourcc *, short);
+short path_toabsolutesystempath(short, const char *, char *);
+short path_nameconform(const char *, char *, long, long);
+short path_getdefault(void);
+double sys_getsr(void);
+
+// Test hooks, defined in stubs.c
+extern long stub_fail_alloc;    // Makes the sysmem allocation this many allocations from now fail (-1 never fails)
+extern long stub_errors;        // Number of object_error calls so far
+extern long stub_warnings;      // Number of object_warn calls so far
@@ -0,0 +1,10 @@
+#pragma once
+typedef struct _buffer_ref t_buffer_ref;
+typedef struct _buffer_obj t_buffer_obj;
+t_buffer_ref *buffer_ref_new(t_object *, t_symbol *);
+t_buffer_obj *buffer_ref_getobject(t_buffer_ref *);
+float *buffer_locksamples(t_buffer_obj *);
+void buffer_unlocksamples(t_buffer_obj *);
+long buffer_getchannelcount(t_buffer_obj *);
+long buffer_getframecount(t_buffer_obj *);
+void buffer_setdirty(t_buffer_obj *);
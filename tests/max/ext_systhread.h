@@ -0,0 +1,7 @@
+#pragma once
+typedef void *t_systhread;
+#define SYSTHREAD_PRIORITY_MIN -30
+long systhread_create(method, void *, unsigned long, long, long, t_systhread *);
+long systhread_join(t_systhread, unsigned int *);
+void systhread_exit(long);
+void systhread_sleep(unsigned long);
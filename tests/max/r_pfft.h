@@ -0,0 +1,7 @@
+#pragma once
+// The fields of pfft~'s published struct that nb.binterpolate~ reads. A test can publish one through gensym("__pfft~__")->s_thing.
+typedef struct _pfftpub {
+    long    x_fftsize;
+    long    x_ffthop;
+    char    x_fullspect;
+} t_pfftpub;
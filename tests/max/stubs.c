@@ -0,0 +1,130 @@
+// Definitions for the stub Max API in this directory
+// Messages are printed to stdout, deferred calls run straight away and objects are never freed.
+
+#include "ext.h"
+#include "z_dsp.h"
+#include "ext_buffer.h"
+#include "ext_systhread.h"
+#include <stdarg.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define MAX_SYMBOLS 256
+
+struct _class { long size; method newm, freem; };
+struct _clock { int unused; };
+
+static t_class theClass;
+
+// Set by a test to make the allocation this many sysmem allocations from now fail (-1 never fails)
+long stub_fail_alloc = -1;
+
+// Number of errors and warnings posted so far
+long stub_errors = 0;
+long stub_warnings = 0;
+
+static int failAlloc(void) {
+    return stub_fail_alloc >= 0 && stub_fail_alloc-- == 0;
+}
+
+t_symbol *gensym(const char *s) {
+    static t_symbol symbols[MAX_SYMBOLS];
+    static int count;
+    for (int i = 0; i < count; i++) {
+        if (strcmp(symbols[i].s_name, s) == 0)
+            return &symbols[i];
+    }
+    if (count == MAX_SYMBOLS) {
+        fprintf(stderr, "gensym: too many symbols\n");
+        abort();
+    }
+    symbols[count].s_name = strdup(s);
+    symbols[count].s_thing = NULL;
+    return &symbols[count++];
+}
+
+static void print(const char *prefix, const char *fmt, va_list args) {
+    fputs(prefix, stdout);
+    vprintf(fmt, args);
+    putchar('\n');
+}
+
+void post(const char *fmt, ...) { va_list a; va_start(a, fmt); print("", fmt, a); va_end(a); }
+void object_post(t_object *o, const char *fmt, ...) { va_list a; va_start(a, fmt); print("[post] ", fmt, a); va_end(a); }
+void object_error(t_object *o, const char *fmt, ...) { va_list a; va_start(a, fmt); print("[error] ", fmt, a); va_end(a); stub_errors++; }
+void object_warn(t_object *o, const char *fmt, ...) { va_list a; va_start(a, fmt); print("[warn] ", fmt, a); va_end(a); stub_warnings++; }
+
+void *sysmem_newptr(long size) { return failAlloc() ? NULL : malloc(size); }
+void *sysmem_newptrclear(long size) { return failAlloc() ? NULL : calloc(1, size); }
+void sysmem_freeptr(void *p) { free(p); }
+
+t_class *class_new(const char *name, method newm, method freem, long size, method m, short type, ...) {
+    theClass.size = size;
+    theClass.newm = newm;
+    theClass.freem = freem;
+    return &theClass;
+}
+int class_addmethod(t_class *c, method m, const char *name, ...) { return 0; }
+int class_register(int box, t_class *c) { return 0; }
+void *object_alloc(t_class *c) { return calloc(1, c->size); }
+int object_free(void *x) { return 0; }
+void *object_method(void *o, t_symbol *s, ...) { return NULL; }
+void *outlet_new(void *x, const char *type) { return (void *)1; }
+long proxy_getinlet(t_object *o) { return 0; }
+
+double atom_getfloat(const t_atom *a) { return a->type == A_FLOAT ? a->w.f : a->w.l; }
+long atom_getlong(const t_atom *a) { return a->type == A_FLOAT ? (long)a->w.f : a->w.l; }
+int atom_setlong(t_atom *a, long l) { a->type = A_LONG; a->w.l = l; return 0; }
+int atom_setfloat(t_atom *a, double f) { a->type = A_FLOAT; a->w.f = f; return 0; }
+
+t_clock *clock_new(void *o, method m) { return calloc(1, sizeof(t_clock)); }
+void clock_fdelay(t_clock *c, double ms) {}
+void clock_unset(t_clock *c) {}
+void defer_low(void *o, method m, t_symbol *s, short argc, t_atom *argv) {
+    ((void (*)(void *, t_symbol *, long, t_atom *))m)(o, s, argc, argv);
+}
+
+void strncpy_zero(char *dst, const char *src, long size) { strncpy(dst, src, size - 1); dst[size - 1] = 0; }
+short locatefile_extended(char *name, short *path, t_fourcc *type, const t_fourcc *types, short count) { *path = 0; return access(name, R_OK) != 0; }
+short path_toabsolutesystempath(short path, const char *name, char *out) { strcpy(out, name); return 0; }
+short path_nameconform(const char *in, char *out, long style, long type) { strcpy(out, in); return 0; }
+short path_getdefault(void) { return 0; }
+double sys_getsr(void) { return 44100; }
+
+void dsp_setup(t_pxobject *x, long inlets) {}
+void dsp_free(t_pxobject *x) {}
+void class_dspinit(t_class *c) {}
+
+typedef struct { method f; void *arg; } t_start;
+
+static void *startThread(void *p) {
+    t_start start = *(t_start *)p;
+    free(p);
+    ((void *(*)(void *))start.f)(start.arg);
+    return NULL;
+}
+
+long systhread_create(method f, void *arg, unsigned long stack, long priority, long flags, t_systhread *thread) {
+    pthread_t *t = malloc(sizeof(pthread_t));
+    t_start *start = malloc(sizeof(t_start));
+    start->f = f;
+    start->arg = arg;
+    if (pthread_create(t, NULL, startThread, start) != 0) {
+        free(t);
+        free(start);
+        return 1;
+    }
+    *thread = t;
+    return 0;
+}
+long systhread_join(t_systhread t, unsigned int *ret) { pthread_join(*(pthread_t *)t, NULL); free(t); return 0; }
+void systhread_exit(long status) {}
+void systhread_sleep(unsigned long ms) { usleep(ms * 1000); }
+
+t_buffer_ref *buffer_ref_new(t_object *o, t_symbol *name) { return NULL; }
+t_buffer_obj *buffer_ref_getobject(t_buffer_ref *r) { return NULL; }
+float *buffer_locksamples(t_buffer_obj *b) { return NULL; }
+void buffer_unlocksamples(t_buffer_obj *b) {}
+long buffer_getchannelcount(t_buffer_obj *b) { return 0; }
+long buffer_getframecount(t_buffer_obj *b) { return 0; }
+void buffer_setdirty(t_buffer_obj *b) {}
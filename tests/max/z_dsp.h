@@ -0,0 +1,6 @@
+#pragma once
+typedef struct _pxobject { t_object z_ob; long z_misc; } t_pxobject;
+#define Z_NO_INPLACE 1
+void dsp_setup(t_pxobject *, long);
+void dsp_free(t_pxobject *);
+void class_dspinit(t_class *);
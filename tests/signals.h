@@ -0,0 +1,53 @@
+// Test signals for the benchmark and soak test, as frames of pfft~ output
+
+// Test signals
+enum {
+    SIGNAL_NOISE,           // Random magnitudes and phases in every frame
+    SIGNAL_HARMONIC,        // 220 Hz harmonic series with slowly changing partial levels
+    SIGNAL_SWEEP,           // Single partial sweeping from 50 Hz to 10 kHz every 10 seconds
+    NUM_SIGNALS
+};
+static const char *signalNames[NUM_SIGNALS] = {"noise", "harmonic", "sweep"};
+
+/**
+ * Generate one frame of a test signal, with magnitudes at the level pfft~ gives a full-scale sinusoid
+ * @param rng state of the random number generator used by the noise signal
+ */
+static void testSignal(int signal, long frame, long bins, int sampleRate, uint64_t *rng, double *mag, double *phase) {
+    double scale = bins / 2.;
+    double binHz = (double)sampleRate / bins;
+    double t = (double)frame * bins / sampleRate;
+
+    if (signal == SIGNAL_NOISE) {
+        for (long i = 0; i < bins; i++) {
+            uint64_t s = *rng;
+            s ^= s >> 12;
+            s ^= s << 25;
+            s ^= s >> 27;
+            *rng = s;
+            uint64_t r = s * 0x2545F4914F6CDD1DULL;
+            mag[i] = scale * (double)(r >> 32) / UINT32_MAX;
+            phase[i] = 2 * M_PI * (double)(r & UINT32_MAX) / UINT32_MAX - M_PI;
+        }
+        return;
+    }
+    for (long i = 0; i < bins; i++) {
+        mag[i] = 1e-3 * scale;
+        phase[i] = 0;
+    }
+    if (signal == SIGNAL_HARMONIC) {
+        for (int k = 1; k * 220. < sampleRate / 2.; k++) {
+            long bin = lround(k * 220. / binHz);
+            if (bin >= bins)
+                break;
+            mag[bin] = scale / k * (1 + 0.5 * sin(2 * M_PI * 0.1 * k * t));
+            phase[bin] = fmod(2 * M_PI * k * 220. * t, 2 * M_PI) - M_PI;
+        }
+    } else {
+        double peak = 50. * pow(200., fmod(t, 10.) / 10.) / binHz;
+        for (long bin = MAX(0, (long)peak - 3); bin <= (long)peak + 3 && bin < bins; bin++) {
+            mag[bin] = scale * exp(-0.5 * (bin - peak) * (bin - peak));
+            phase[bin] = fmod(2 * M_PI * peak * binHz * t, 2 * M_PI) - M_PI;
+        }
+    }
+}
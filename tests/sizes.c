@@ -0,0 +1,66 @@
+// Runs FFT sizes that aren't powers of 2, from a handful of bins up to MAX_FFT_SIZE, through the per-bin state with morph,
+// overlap and cartesian on, and checks every output is finite. The vector size doesn't divide any of the sizes, so the last
+// vector of each frame is a short one.
+
+#include "../nb.binterpolate~.c"
+
+#define VECTOR_SIZE 64
+#define FRAMES 12
+
+static int runSize(long fftSize) {
+    t_atom argv[3];
+    atom_setfloat(argv, 0.2);
+    atom_setfloat(argv+1, 0.1);
+    atom_setlong(argv+2, fftSize);
+    t_interp *x = interp_new(gensym("nb.binterpolate~"), 3, argv);
+    if (!x || x->fftSize != fftSize) {
+        printf("sizes: couldn't create an object with %ld bins\n", fftSize);
+        return 1;
+    }
+    interp_overlap(x, 0.05);
+    interp_cartesian(x, 1);
+    interp_dsp64(x, NULL, NULL, 44100, VECTOR_SIZE, 0);
+    
+    double in_mag[VECTOR_SIZE], in_phase[VECTOR_SIZE], in_index[VECTOR_SIZE], out_mag[VECTOR_SIZE], out_phase[VECTOR_SIZE];
+    double *ins[3] = {in_mag, in_phase, in_index};
+    double *outs[2] = {out_mag, out_phase};
+    long bad = 0;
+    for (int f = 0; f < FRAMES; f++) {
+        if (f == 1)
+            interp_snap(x, 0);
+        if (f == 4)
+            interp_snap(x, 3);
+        if (f == 8) {
+            t_atom weights[4];
+            for (int i = 0; i < 4; i++)
+                atom_setfloat(weights + i, 1);
+            interp_morph(x, NULL, 4, weights);
+        }
+        for (long start = 0; start < fftSize; start += VECTOR_SIZE) {
+            long n = MIN(fftSize - start, VECTOR_SIZE);
+            for (long i = 0; i < n; i++) {
+                in_mag[i] = sin(i + f);
+                in_phase[i] = cos(i * f);
+                in_index[i] = start + i;
+            }
+            interp_perform64(x, NULL, ins, 3, outs, 2, n, 0, NULL);
+            for (long i = 0; i < n; i++)
+                bad += !isfinite(out_mag[i]) || !isfinite(out_phase[i]);
+        }
+    }
+    interp_free(x);
+    if (bad)
+        printf("sizes: %ld non-finite outputs with %ld bins\n", bad, fftSize);
+    return bad != 0;
+}
+
+int main(void) {
+    ext_main(NULL);
+    static const long sizes[] = {7, 3000, 100000, MAX_FFT_SIZE};
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        failed |= runSize(sizes[i]);
+    if (!failed)
+        printf("sizes: ok\n");
+    return failed;
+}
@@ -0,0 +1,333 @@
+// Soak test, run with make soak (not part of make test). Runs an instance through hours of simulated noise input as fast as it
+// can, once for each of plain per-bin glides, overlap, rest and the compact layout:
+// - Every output value is checked against the closed-form glide the bin should be on: the straight line from its previous
+//   target to the input it retargeted to (rounded to half precision in the compact layout), crossfaded from the previous glide
+//   with overlap, and holding its target while it rests. This catches increments that accumulate error.
+// - The run is split into cycles of an hour (or at least MIN_CYCLES of them). After each cycle an extra instance with every mode
+//   on is created, run and freed, and the resident memory is taken, to catch leaks.
+// A mode fails if the output ever drifts by more than MAX_DRIFT, if the frame time grows by more than TIME_GROWTH from the
+// first cycles to the last, or if memory grows by more than RSS_GROWTH over the second half of the run (the first half gives
+// the memory allocator time to settle, while a leak keeps growing).
+//
+//   soak [hours [fft size [length [variance]]]]
+
+#include "../nb.binterpolate~.c"
+#include "signals.h"
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+#define VECTOR_SIZE 256
+#define SEED 1                  // Seed of the glide lengths and the noise
+#define MIN_CYCLES 8            // Each mode is measured in at least this many cycles, so short runs still show trends
+#define CHURN_FRAMES 8          // Frames run through the instance created and freed in each cycle
+#define MAX_DRIFT 1e-9          // Largest relative difference from the closed-form glide a mode passes with
+#define TIME_GROWTH 1.5         // Largest growth in frame time (fastest of the last quarter / fastest of the first) it passes with
+#define RSS_GROWTH 1048576      // Largest growth in resident memory (in bytes) over the second half it passes with
+#define OVERLAP_SECS 0.5
+#define REST_SECS 1
+
+static const struct {
+    const char* name;
+    char        compact;
+    char        overlap;
+    char        rest;
+} modes[] = {
+    { "plain",      0,  0,  0 },
+    { "overlap",    0,  1,  0 },
+    { "rest",       0,  0,  1 },
+    { "compact",    1,  0,  0 },
+};
+#define NUM_MODES (int)(sizeof(modes) / sizeof(modes[0]))
+
+// A glide a bin has been on
+typedef struct _glide {
+    double      startMag;               // Value at the start of the glide (the previous target)
+    double      startPhase;
+    double      targetMag;              // Input when the glide started
+    double      targetPhase;
+    long        frames;                 // Length of the glide (0 before the first one)
+    long        step;                   // Frames of the glide output so far
+} t_glide;
+
+// The glide a bin is on, and the one before it, which overlap crossfades from
+typedef struct _track {
+    t_glide     now;
+    t_glide     last;
+} t_track;
+
+/**
+ * @return the memory the process has resident at the moment in bytes, or 0 if it can't be found
+ * (The peak from getrusage would hide a leak behind any earlier, larger allocation.)
+ */
+static long residentBytes(void) {
+#ifdef __APPLE__
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+        return 0;
+    return (long)info.resident_size;
+#else
+    long pages = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (!fp)
+        return 0;
+    if (fscanf(fp, "%*s %ld", &pages) != 1)
+        pages = 0;
+    fclose(fp);
+    return pages * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static t_interp *newInstance(long fftSize, double length, double variance, char compact) {
+    t_atom argv[4];
+    atom_setfloat(argv, length);
+    atom_setfloat(argv+1, variance);
+    atom_setlong(argv+2, fftSize);
+    atom_setlong(argv+3, compact);
+    t_interp *x = interp_new(gensym("nb.binterpolate~"), 4, argv);
+    if (!x)
+        return NULL;
+    seedRandom(x, SEED);
+    interp_dsp64(x, NULL, NULL, x->sampleRate, MIN(VECTOR_SIZE, fftSize), 0);
+    return x;
+}
+
+/**
+ * Free an instance, including the object itself, which the stub Max API leaves to Max
+ */
+static void freeInstance(t_interp *x) {
+    interp_free(x);
+    free(x->eventClock);
+    free(x);
+}
+
+/**
+ * Run one frame through an instance
+ */
+static void runFrame(t_interp *x, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase) {
+    long vector = MIN(VECTOR_SIZE, x->fftSize);
+    for (long v = 0; v < x->fftSize; v += vector) {
+        double *ins[3] = {in_mag + v, in_phase + v, in_index + v};
+        double *outs[2] = {out_mag + v, out_phase + v};
+        interp_perform64(x, NULL, ins, 3, outs, 2, MIN(vector, x->fftSize - v), 0, NULL);
+    }
+}
+
+/**
+ * Create an instance, switch on every mode that allocates memory, run a few frames through it and free it again
+ * @return 1 if the instance could be created
+ */
+static int churnInstance(long fftSize, double *in_mag, double *in_phase, double *in_index, double *out_mag, double *out_phase) {
+    t_interp *c = newInstance(fftSize, DEFAULT_LENGTH, DEFAULT_VARIANCE, 0);
+    if (!c)
+        return 0;
+    interp_overlap(c, 0.5);
+    interp_rest(c, 1);
+    interp_cartesian(c, 1);
+    interp_snap(c, 0);
+    interp_bands(c, 32);
+    interp_cepstrum(c, 20);
+    interp_probe(c, 0);
+    for (long frame = 0; frame < CHURN_FRAMES; frame++)
+        runFrame(c, in_mag, in_phase, in_index, out_mag, out_phase);
+    freeInstance(c);
+    return 1;
+}
+
+/**
+ * Find where a glide is after step frames (carrying on at the same slope past its end)
+ */
+static void glideAt(const t_glide *g, long step, double *mag, double *phase) {
+    if (g->frames == 0) {
+        *mag = g->targetMag;
+        *phase = g->targetPhase;
+        return;
+    }
+    double fraction = (double)step / g->frames;
+    *mag = g->startMag + (g->targetMag - g->startMag) * fraction;
+    *phase = g->startPhase + (g->targetPhase - g->startPhase) * fraction;
+}
+
+static double relativeError(double out, double expected, double scale) {
+    return fabs(out - expected) / MAX(scale, 1e-3);
+}
+
+/**
+ * Check one vector of output against the glides the bins should be on
+ * A bin that retargeted in this vector starts a glide from its previous target to the input, over the number of frames it drew.
+ * @param retargeted 1 for each bin that retargeted in the vector
+ * @param processed 1 for each bin that wasn't resting
+ * @return the largest difference from the closed-form glide, relative to the largest value the glides involved reach
+ */
+static double checkVector(t_interp *x, t_track *tracks, const double *in_mag, const double *in_phase, const char *retargeted, const char *processed, const double *out_mag, const double *out_phase, long first, long n) {
+    double worst = 0;
+    for (long k = 0; k < n; k++) {
+        long bin = first + k;
+        t_track *t = tracks + bin;
+        if (retargeted[k]) {
+            t->last = t->now;
+            t->now.startMag = t->now.targetMag;
+            t->now.startPhase = t->now.targetPhase;
+            t->now.targetMag = in_mag[k];
+            t->now.targetPhase = in_phase[k];
+            if (x->compact) {
+                t->now.targetMag = unpackHalf(x, packHalf(x, in_mag[k]));
+                t->now.targetPhase = unpackHalf(x, packHalf(x, in_phase[k]));
+                t->now.frames = x->framesLeft[bin] + 1;
+            } else {
+                t->now.frames = x->totalFrames[bin];
+            }
+            t->now.step = 0;
+        }
+        if (processed[k])
+            t->now.step++;
+        double mag, phase;
+        glideAt(&t->now, t->now.step, &mag, &phase);
+        double scaleMag = MAX(fabs(t->now.startMag), fabs(t->now.targetMag));
+        double scalePhase = MAX(fabs(t->now.startPhase), fabs(t->now.targetPhase));
+        if (x->overlapFrames && processed[k] && t->now.step <= x->overlapFrames) {
+            double fadeMag, fadePhase;
+            glideAt(&t->last, t->last.frames + t->now.step, &fadeMag, &fadePhase);
+            double w = MIN((x->overlapFrames - t->now.step + 1) / (x->overlapFrames + 1.), 1.);
+            mag += w * (fadeMag - mag);
+            phase += w * (fadePhase - phase);
+            scaleMag = MAX(scaleMag, fabs(fadeMag));
+            scalePhase = MAX(scalePhase, fabs(fadePhase));
+        }
+        double magError = relativeError(out_mag[k], mag, scaleMag);
+        double phaseError = relativeError(out_phase[k], phase, scalePhase);
+        if (!(worst >= magError))
+            worst = magError;
+        if (!(worst >= phaseError))
+            worst = phaseError;
+    }
+    return worst;
+}
+
+/**
+ * Soak one mode
+ * @return 1 if it passed
+ */
+static int soak(int mode, double hours, long bins, double length, double variance) {
+    long vector = MIN(VECTOR_SIZE, bins);
+    long cycles = MAX(MIN_CYCLES, (long)ceil(hours));
+    t_interp *x = newInstance(bins, length, variance, modes[mode].compact);
+    if (!x || x->fftSize != bins) {
+        printf("soak: couldn't create an instance with an FFT size of %ld\n", bins);
+        return 0;
+    }
+    if (modes[mode].overlap)
+        interp_overlap(x, OVERLAP_SECS);
+    if (modes[mode].rest)
+        interp_rest(x, REST_SECS);
+    long cycleFrames = MAX(1, (long)(hours * 3600. * x->sampleRate / bins / cycles));
+    t_track *tracks = (t_track *)calloc(bins, sizeof(t_track));
+    double *buffers = (double *)calloc(bins * 5, sizeof(double));
+    double *cycleTime = (double *)calloc(cycles, sizeof(double));
+    double *cycleDrift = (double *)calloc(cycles, sizeof(double));
+    long *cycleMemory = (long *)calloc(cycles, sizeof(long));
+    if (!tracks || !buffers || !cycleTime || !cycleDrift || !cycleMemory) {
+        printf("soak: not enough memory\n");
+        return 0;
+    }
+
+    printf("soak: %s: %g hours of %ld bins in %ld cycles of %ld frames\n", modes[mode].name, hours, bins, cycles, cycleFrames);
+    double *inMag = buffers;
+    double *inPhase = inMag + bins;
+    double *index = inPhase + bins;
+    double *outMag = index + bins;
+    double *outPhase = outMag + bins;
+    for (long i = 0; i < bins; i++)
+        index[i] = i;
+    uint64_t rng = SEED;
+    for (long c = 0; c < cycles; c++) {
+        double seconds = 0;
+        double drift = 0;
+        for (long frame = 0; frame < cycleFrames; frame++) {
+            testSignal(SIGNAL_NOISE, frame, bins, x->sampleRate, &rng, inMag, inPhase);
+            for (long v = 0; v < bins; v += vector) {
+                long n = MIN(vector, bins - v);
+                // A bin retargets if it is due to and isn't resting. Resting bins whose rest ends in this frame wake up in the
+                // vector that starts it, before anything is processed.
+                char retargeted[VECTOR_SIZE], processed[VECTOR_SIZE];
+                for (long k = 0; k < n; k++) {
+                    long bin = v + k;
+                    processed[k] = !x->restAwake || (x->restAwake[bin >> 6] & (1ULL << (bin & 63)))
+                                   || (v == 0 && x->wakeFrame[bin] <= x->frameNumber + 1);
+                    retargeted[k] = processed[k] && x->updateTarget[bin];
+                }
+                double *ins[3] = {inMag + v, inPhase + v, index + v};
+                double *outs[2] = {outMag + v, outPhase + v};
+                double start = monotonicTime();
+                interp_perform64(x, NULL, ins, 3, outs, 2, n, 0, NULL);
+                seconds += monotonicTime() - start;
+                double d = checkVector(x, tracks, inMag + v, inPhase + v, retargeted, processed, outMag + v, outPhase + v, v, n);
+                if (!(drift >= d))
+                    drift = d;
+            }
+        }
+        if (!churnInstance(bins, inMag, inPhase, index, outMag, outPhase)) {
+            printf("soak: not enough memory\n");
+            return 0;
+        }
+        cycleTime[c] = seconds / cycleFrames;
+        cycleDrift[c] = drift;
+        cycleMemory[c] = residentBytes();
+        printf("soak: %s: cycle %ld/%ld: drift %.3g, frame time %.1f us, memory %.1f MB\n",
+               modes[mode].name, c + 1, cycles, drift, 1e6 * cycleTime[c], cycleMemory[c] / 1048576.);
+        fflush(stdout);
+    }
+    freeInstance(x);
+
+    // Compare the fastest frame time of the first and last quarter, which ignores cycles slowed down by other work on the machine
+    long quarter = MAX(1, cycles / 4);
+    double worstDrift = 0;
+    double firstTime = INFINITY;
+    double lastTime = INFINITY;
+    for (long c = 0; c < cycles; c++) {
+        if (!(worstDrift >= cycleDrift[c]))
+            worstDrift = cycleDrift[c];
+        if (c < quarter)
+            firstTime = MIN(firstTime, cycleTime[c]);
+        if (c >= cycles - quarter)
+            lastTime = MIN(lastTime, cycleTime[c]);
+    }
+    long growth = cycleMemory[cycles-1] - cycleMemory[cycles/2 - 1];
+    int passed = 1;
+    if (!(worstDrift <= MAX_DRIFT)) {
+        printf("soak: %s: failed: the output drifted from the closed-form glides by %g\n", modes[mode].name, worstDrift);
+        passed = 0;
+    }
+    if (lastTime > TIME_GROWTH * firstTime) {
+        printf("soak: %s: failed: the frame time grew from %.1f us to %.1f us\n", modes[mode].name, 1e6 * firstTime, 1e6 * lastTime);
+        passed = 0;
+    }
+    if (growth > RSS_GROWTH) {
+        printf("soak: %s: failed: memory grew by %.1f MB over the second half\n", modes[mode].name, growth / 1048576.);
+        passed = 0;
+    }
+    if (passed)
+        printf("soak: %s: passed (drift %.3g, frame time %.1f us to %.1f us, memory grew by %ld KB over the second half)\n",
+               modes[mode].name, worstDrift, 1e6 * firstTime, 1e6 * lastTime, growth / 1024);
+    free(tracks);
+    free(buffers);
+    free(cycleTime);
+    free(cycleDrift);
+    free(cycleMemory);
+    return passed;
+}
+
+int main(int argc, char **argv) {
+    ext_main(NULL);
+    double hours = (argc > 1) ? atof(argv[1]) : 24;
+    long bins = (argc > 2) ? atol(argv[2]) : 4096;
+    double length = (argc > 3) ? atof(argv[3]) : DEFAULT_LENGTH;
+    double variance = (argc > 4) ? atof(argv[4]) : DEFAULT_VARIANCE;
+    int failed = 0;
+    for (int mode = 0; mode < NUM_MODES; mode++)
+        failed |= !soak(mode, hours, bins, length, variance);
+    if (!failed)
+        printf("soak: ok\n");
+    return failed;
+}
@@ -0,0 +1,160 @@
+// Checks the optional stages of the interpolation kernel:
+// - For all 64 combinations of stages, the kernel selectGlide compiles for them gives bit-identical output to the generic
+//   glideKernel. Two identical objects get the same frame boundaries through the perform method, then one runs the selected
+//   kernel and the other glideKernel.
+// - gain and gate apply in every kernel except bypass: doubling the gain doubles the magnitudes (both components in cartesian
+//   mode), and gated bins are output as 0.
+
+#include "../nb.binterpolate~.c"
+
+#define FFT_SIZE 512
+#define VECTOR_SIZE 64
+#define FRAMES 200
+#define GATE 0.3
+
+static void makeInput(int frame, long start, double *mag, double *phase, double *index) {
+    for (long i = 0; i < VECTOR_SIZE; i++) {
+        mag[i] = fabs(sin(0.01 * (start + i) * (frame % 37 + 1))) + 0.05 * (frame % 5);
+        phase[i] = cos(0.7 * (start + i) + frame);
+        index[i] = start + i;
+    }
+}
+
+static t_interp *newObject(unsigned stages) {
+    t_atom argv[4];
+    atom_setfloat(argv, 0.05);
+    atom_setfloat(argv+1, 0.03);
+    atom_setlong(argv+2, FFT_SIZE);
+    atom_setlong(argv+3, (stages & STAGE_COMPACT) != 0);
+    t_interp *x = interp_new(gensym("nb.binterpolate~"), 4, argv);
+    seedRandom(x, 1);
+    interp_dsp64(x, NULL, NULL, 44100, VECTOR_SIZE, 0);
+    if (stages & STAGE_OVERLAP)
+        interp_overlap(x, 0.02);
+    if (stages & STAGE_CARTESIAN)
+        interp_cartesian(x, 1);
+    if (stages & STAGE_REST)
+        interp_rest(x, 0.05);
+    if (stages & STAGE_GAIN)
+        interp_gain(x, 1.5);
+    if (stages & STAGE_GATE)
+        interp_gate(x, GATE);
+    return x;
+}
+
+/**
+ * Run the frame boundary of the perform method without processing any bins, and return the kernel it picked
+ */
+static t_interp_kernel startFrame(t_interp *x) {
+    double index[1] = {0};      // A vector of no bins starting at bin 0
+    double empty[1] = {0};
+    double *ins[3] = {empty, empty, index};
+    double *outs[2] = {empty, empty};
+    interp_perform64(x, NULL, ins, 3, outs, 2, 0, 0, NULL);
+    return x->kernel;
+}
+
+static int checkCombination(unsigned stages) {
+    t_interp *compiled = newObject(stages);
+    t_interp *generic = newObject(stages);
+    double mag[VECTOR_SIZE], phase[VECTOR_SIZE], index[VECTOR_SIZE];
+    double outCompiled[2][VECTOR_SIZE], outGeneric[2][VECTOR_SIZE];
+    int failed = 0;
+    
+    for (int f = 0; f < FRAMES && !failed; f++) {
+        t_interp_kernel kernel = startFrame(compiled);
+        startFrame(generic);
+        if (activeStages(compiled) != stages) {
+            printf("stages: combination %u is running with stages %u\n", stages, activeStages(compiled));
+            failed = 1;
+            break;
+        }
+        for (long start = 0; start < FFT_SIZE; start += VECTOR_SIZE) {
+            makeInput(f, start, mag, phase, index);
+            kernel(compiled, mag, phase, index, outCompiled[0], outCompiled[1], VECTOR_SIZE);
+            glideKernel(generic, mag, phase, index, outGeneric[0], outGeneric[1], VECTOR_SIZE);
+            if (memcmp(outCompiled, outGeneric, sizeof(outCompiled)) != 0) {
+                printf("stages: combination %u differs from the generic kernel in frame %d\n", stages, f);
+                failed = 1;
+                break;
+            }
+        }
+    }
+    interp_free(compiled);
+    interp_free(generic);
+    return failed;
+}
+
+enum { MODE_GLIDE, MODE_FREEZE, MODE_MORPH, MODE_BANDS, MODE_CEPSTRUM, NUM_MODES };
+static const char *modeNames[NUM_MODES] = {"glide", "freeze", "morph", "bands", "cepstrum"};
+
+/**
+ * Run an object in one mode for a while and return the output of its last frame
+ */
+static void runMode(int mode, char cartesian, double gain, double gate, double out[2][FFT_SIZE]) {
+    t_interp *x = newObject(cartesian ? STAGE_CARTESIAN : 0);
+    interp_gain(x, gain);
+    interp_gate(x, gate);
+    double mag[VECTOR_SIZE], phase[VECTOR_SIZE], index[VECTOR_SIZE];
+    double *ins[3] = {mag, phase, index};
+    for (int f = 0; f < 60; f++) {
+        if (f == 2)
+            interp_snap(x, 0);
+        if (f == 10 && mode == MODE_MORPH)
+            interp_snap(x, 1);
+        if (f == 20) {
+            if (mode == MODE_FREEZE)
+                interp_freeze(x, 1);
+            if (mode == MODE_BANDS)
+                interp_bands(x, 16);
+            if (mode == MODE_CEPSTRUM)
+                interp_cepstrum(x, 12);
+            if (mode == MODE_MORPH) {
+                t_atom weights[2];
+                atom_setfloat(weights, 1);
+                atom_setfloat(weights+1, 2);
+                interp_morph(x, NULL, 2, weights);
+            }
+        }
+        for (long start = 0; start < FFT_SIZE; start += VECTOR_SIZE) {
+            makeInput(f, start, mag, phase, index);
+            double *outs[2] = {out[0] + start, out[1] + start};
+            interp_perform64(x, NULL, ins, 3, outs, 2, VECTOR_SIZE, 0, NULL);
+        }
+    }
+    interp_free(x);
+}
+
+static int checkShaping(int mode, char cartesian) {
+    static double plain[2][FFT_SIZE], gained[2][FFT_SIZE], gated[2][FFT_SIZE];
+    runMode(mode, cartesian, 1, 0, plain);
+    runMode(mode, cartesian, 2, 0, gained);
+    runMode(mode, cartesian, 1, GATE, gated);
+    long badGain = 0, badGate = 0;
+    for (long i = 0; i < FFT_SIZE; i++) {
+        double expectedPhase = cartesian ? 2 * plain[1][i] : plain[1][i];
+        badGain += gained[0][i] != 2 * plain[0][i] || gained[1][i] != expectedPhase;
+        double level = cartesian ? hypot(plain[0][i], plain[1][i]) : fabs(plain[0][i]);
+        if (level < GATE)
+            badGate += gated[0][i] != 0 || (cartesian && gated[1][i] != 0);
+        else
+            badGate += gated[0][i] != plain[0][i];
+    }
+    if (badGain || badGate)
+        printf("stages: %s%s: %ld bins with the wrong gain, %ld with the wrong gate\n", modeNames[mode], cartesian ? " (cartesian)" : "", badGain, badGate);
+    return badGain || badGate;
+}
+
+int main(void) {
+    ext_main(NULL);
+    int failed = 0;
+    for (unsigned stages = 0; stages < 64; stages++)
+        failed |= checkCombination(stages);
+    for (int mode = 0; mode < NUM_MODES; mode++) {
+        failed |= checkShaping(mode, 0);
+        failed |= checkShaping(mode, 1);
+    }
+    if (!failed)
+        printf("stages: ok\n");
+    return failed;
+}
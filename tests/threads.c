@@ -0,0 +1,65 @@
+// Runs 16 instances on 16 threads at once, as poly~ does with parallel voices. Every instance is seeded the same, so if the
+// instances share any state through the perform method they drift apart. Build with ThreadSanitizer to check for races too.
+
+#include "../nb.binterpolate~.c"
+#include <pthread.h>
+
+#define THREADS 16
+#define FFT_SIZE 1024
+#define FRAMES 300
+
+typedef struct {
+    t_interp *x;
+    double sum;
+} t_run;
+
+static void *run(void *p) {
+    t_run *r = p;
+    double in_mag[FFT_SIZE], in_phase[FFT_SIZE], in_index[FFT_SIZE], out_mag[FFT_SIZE], out_phase[FFT_SIZE];
+    double *ins[3] = {in_mag, in_phase, in_index};
+    double *outs[2] = {out_mag, out_phase};
+    for (int f = 0; f < FRAMES; f++) {
+        for (int i = 0; i < FFT_SIZE; i++) {
+            in_mag[i] = fabs(sin(i*0.01 + f));
+            in_phase[i] = 1;
+            in_index[i] = i;
+        }
+        interp_perform64(r->x, NULL, ins, 3, outs, 2, FFT_SIZE, 0, NULL);
+        for (int i = 0; i < FFT_SIZE; i++)
+            r->sum += out_mag[i] + out_phase[i];
+    }
+    return NULL;
+}
+
+int main(void) {
+    ext_main(NULL);
+    t_run runs[THREADS];
+    pthread_t threads[THREADS];
+    t_atom argv[3];
+    atom_setfloat(argv, 0.05);
+    atom_setfloat(argv+1, 0.02);
+    atom_setlong(argv+2, FFT_SIZE);
+    for (int i = 0; i < THREADS; i++) {
+        runs[i].x = interp_new(gensym("nb.binterpolate~"), 3, argv);
+        runs[i].sum = 0;
+        seedRandom(runs[i].x, 1);
+        interp_dsp64(runs[i].x, NULL, NULL, 44100, 64, 0);
+    }
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, run, &runs[i]);
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+    
+    int failed = 0;
+    for (int i = 1; i < THREADS; i++) {
+        if (runs[i].sum != runs[0].sum) {
+            printf("threads: instance %d differs from instance 0 (%.17g vs %.17g)\n", i, runs[i].sum, runs[0].sum);
+            failed = 1;
+        }
+    }
+    for (int i = 0; i < THREADS; i++)
+        interp_free(runs[i].x);
+    if (!failed)
+        printf("threads: ok\n");
+    return failed;
+}
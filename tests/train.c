@@ -0,0 +1,108 @@
+// Training workload for the profile-guided build, run with make pgo (not part of make test). Unlike the tests, this doesn't
+// include nb.binterpolate~.c: it links against the external compiled on its own, so the profile it collects is for the same
+// translation unit Xcode builds, and can be passed to the Optimized configuration.
+// Runs every FFT size in fftSizes, in both state layouts, through two workloads in turn:
+// - Retargeting: one-frame glides and noise input, so every bin retargets every frame.
+// - Steady state: long glides and a steady input, so almost every frame is spent adding increments.
+// Prints the time each workload took per bin, and the total.
+//
+//   train [seconds of audio per workload]
+
+#include "ext.h"
+#include "z_dsp.h"
+#include <math.h>
+
+typedef struct _interp t_interp;
+void ext_main(void *r);
+void *interp_new(t_symbol *s, long argc, t_atom *argv);
+void interp_free(t_interp *x);
+void interp_dsp64(t_interp *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
+void interp_perform64(t_interp *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long sampleframes, long flags, void *userparam);
+
+#define VECTOR_SIZE 256
+#define SAMPLE_RATE 44100
+
+static const long fftSizes[] = {256, 1024, 4096, 16384};
+#define NUM_FFT_SIZES (int)(sizeof(fftSizes) / sizeof(fftSizes[0]))
+
+enum { WORKLOAD_RETARGET, WORKLOAD_STEADY, NUM_WORKLOADS };
+static const char *workloadNames[NUM_WORKLOADS] = {"retarget", "steady"};
+static const double workloadLength[NUM_WORKLOADS] = {0, 10};    // Interpolation length and variance in seconds
+static const double workloadVariance[NUM_WORKLOADS] = {0, 2};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/**
+ * Run one workload through an instance with one FFT size and layout
+ * @return the time spent in the perform method in seconds
+ */
+static double run(int workload, long fftSize, char compact, double seconds) {
+    t_atom argv[4];
+    atom_setfloat(argv, workloadLength[workload]);
+    atom_setfloat(argv+1, workloadVariance[workload]);
+    atom_setlong(argv+2, fftSize);
+    atom_setlong(argv+3, compact);
+    t_interp *x = interp_new(gensym("nb.binterpolate~"), 4, argv);
+    long vector = MIN(VECTOR_SIZE, fftSize);
+    interp_dsp64(x, NULL, NULL, SAMPLE_RATE, vector, 0);
+    double *buffers = (double *)calloc(fftSize * 5, sizeof(double));
+    double *inMag = buffers;
+    double *inPhase = inMag + fftSize;
+    double *index = inPhase + fftSize;
+    double *outMag = index + fftSize;
+    double *outPhase = outMag + fftSize;
+    for (long i = 0; i < fftSize; i++) {
+        index[i] = i;
+        inMag[i] = 1 + sin(0.01 * i);
+        inPhase[i] = cos(0.1 * i);
+    }
+
+    long frames = MAX(1, (long)(seconds * SAMPLE_RATE / fftSize));
+    uint64_t rng = 1;
+    double elapsed = 0;
+    for (long frame = 0; frame < frames; frame++) {
+        if (workload == WORKLOAD_RETARGET) {
+            for (long i = 0; i < fftSize; i++) {
+                rng ^= rng << 13;
+                rng ^= rng >> 7;
+                rng ^= rng << 17;
+                inMag[i] = (double)(rng >> 11) / (1ULL << 53) * fftSize / 2;
+                inPhase[i] = (double)(rng & 0xffff) / 0x10000 * 2 * M_PI - M_PI;
+            }
+        }
+        double start = now();
+        for (long v = 0; v < fftSize; v += vector) {
+            double *ins[3] = {inMag + v, inPhase + v, index + v};
+            double *outs[2] = {outMag + v, outPhase + v};
+            interp_perform64(x, NULL, ins, 3, outs, 2, MIN(vector, fftSize - v), 0, NULL);
+        }
+        elapsed += now() - start;
+    }
+    interp_free(x);
+    free(buffers);
+    return elapsed;
+}
+
+int main(int argc, char **argv) {
+    ext_main(NULL);
+    double seconds = (argc > 1) ? atof(argv[1]) : 300;
+    double total = 0;
+    double totalBins = 0;
+    for (int workload = 0; workload < NUM_WORKLOADS; workload++) {
+        for (int f = 0; f < NUM_FFT_SIZES; f++) {
+            for (char compact = 0; compact <= 1; compact++) {
+                double elapsed = run(workload, fftSizes[f], compact, seconds);
+                double bins = (double)MAX(1, (long)(seconds * SAMPLE_RATE / fftSizes[f])) * fftSizes[f];
+                printf("train: %-8s %6ld bins %-8s %7.2f ns/bin\n", workloadNames[workload], fftSizes[f], compact ? "compact" : "full", elapsed * 1e9 / bins);
+                total += elapsed;
+                totalBins += bins;
+            }
+        }
+    }
+    printf("train: total %.3f s, %.2f ns/bin\n", total, total * 1e9 / totalBins);
+    return 0;
+}